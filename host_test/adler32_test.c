@@ -0,0 +1,94 @@
+// Adler-32 of LodePNG zlib wrapper against the bytewise reference of RFC 1950. Built once per
+// host variant of 'update_adler32' - scalar as on ESP32, SSSE3 and AVX2. Lengths cover SIMD
+// blocks and their tails, offsets unaligned loads, and all 0xFF data the largest sums.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lodepng.h"
+#include "pipeline_heap.h"
+
+// Exit code of skipped test, CPU lacks the variant's instructions.
+#define SKIP_CODE 77
+// Longer than a few blocks summed between modulo operations.
+#define MAX_LENGTH (3 * 5552 + 100)
+
+/// @brief Bytewise Adler-32, as defined by RFC 1950.
+static uint32_t reference_adler32(const uint8_t* data, size_t length) {
+    uint32_t s1 = 1;
+    uint32_t s2 = 0;
+    for (size_t i = 0; i < length; ++i) {
+        s1 = (s1 + data[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    return s2 << 16 | s1;
+}
+
+/// @brief  Compress data as zlib stream with stored blocks, as PNG encoder does.
+/// @return Adler-32 from zlib trailer, 0 on failure.
+static uint32_t zlib_stored_adler32(const uint8_t* data, size_t length) {
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.btype = 0;
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    uint32_t adler = 0;
+    if (lodepng_zlib_compress(&out, &out_length, data, length, &settings) == 0) {
+        const uint8_t* trailer = out + out_length - 4;
+        adler = (uint32_t)trailer[0] << 24 | (uint32_t)trailer[1] << 16 |
+                (uint32_t)trailer[2] << 8 | trailer[3];
+    }
+    pipeline_free(out);
+    return adler;
+}
+
+/// @return Number of lengths and offsets not matching reference.
+static int check_data(const char* name, const uint8_t* data) {
+    int failures = 0;
+    for (size_t offset = 0; offset < 4; ++offset) {
+        for (size_t length = 0; length + offset <= MAX_LENGTH; length += length < 256 ? 1 : 97) {
+            const uint32_t adler = zlib_stored_adler32(data + offset, length);
+            const uint32_t expected = reference_adler32(data + offset, length);
+            if (adler != expected && failures++ < 10) {
+                fprintf(stderr, "%s: offset %zu, length %zu: %08x, expected %08x\n", name, offset,
+                        length, adler, expected);
+            }
+        }
+    }
+    return failures;
+}
+
+int main(void) {
+#if defined(__AVX2__)
+    const char* variant = "avx2";
+    if (!__builtin_cpu_supports("avx2")) {
+        return SKIP_CODE;
+    }
+#elif defined(__SSSE3__)
+    const char* variant = "ssse3";
+    if (!__builtin_cpu_supports("ssse3")) {
+        return SKIP_CODE;
+    }
+#else
+    const char* variant = "scalar";
+#endif
+
+    uint8_t* data = malloc(MAX_LENGTH);
+    if (data == NULL) {
+        return 1;
+    }
+    int failures = 0;
+    memset(data, 0xFF, MAX_LENGTH);
+    failures += check_data("0xff", data);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < MAX_LENGTH; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+    failures += check_data("noise", data);
+    free(data);
+
+    printf("%s: %d mismatches\n", variant, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+// Image pipeline benchmark on the development machine. Runs the same benchmarks as
+// 'GET /benchmark' over synthetic prints and over captured prints given as arguments, binary
+// link captures ('GET /capture') of real prints. Results are printed as JSON.
+//
+//   host_benchmark [capture.bin...]
+//
+// Host durations are derived from wall time, compare them only with other host results.
+// Benchmark must leave the published image and received data untouched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "benchmark.h"
+#include "capture.h"
+#include "image_builder.h"
+#include "printer.h"
+
+// Results of all synthetic and up to 8 captured prints.
+#define RESULTS_SIZE (64 * 1024)
+// Max number of image parts of a captured print.
+#define MAX_PARTS 64
+
+/// @brief Packet decoder state, fed with bytes received from GB.
+typedef struct {
+    // Bytes since sync word, -1 while waiting for it.
+    int index;
+    uint8_t command;
+    uint8_t compression;
+    uint16_t length;
+    uint16_t checksum;
+    uint16_t received_checksum;
+    uint8_t data[IMAGE_BUFFER_SIZE];
+} PacketDecoder;
+
+/// @brief Captured print.
+typedef struct {
+    ImageData* parts;
+    int num_parts;
+    // Data of next part, added by data packets.
+    ImageData pending;
+} CapturedPrint;
+
+/// @brief  Handle complete packet with valid checksum, as printer does.
+/// @return False if print can't be benchmarked.
+static bool handle_packet(const PacketDecoder* decoder, CapturedPrint* print) {
+    if (decoder->compression != 0) {
+        fprintf(stderr, "Compressed packets aren't supported\n");
+        return false;
+    }
+
+    switch (decoder->command) {
+        case 0x01: {
+            print->pending.length = 0;
+            break;
+        }
+        case 0x02: {
+            if (decoder->length < 4 || print->num_parts >= MAX_PARTS) {
+                return false;
+            }
+            ImageData* part = &print->parts[print->num_parts++];
+            memcpy(part, &print->pending, sizeof(ImageData));
+            part->number_of_sheets = decoder->data[0];
+            part->margins = decoder->data[1];
+            part->palette = decoder->data[2];
+            part->exposure = decoder->data[3];
+            print->pending.length = 0;
+            break;
+        }
+        case 0x04: {
+            if (print->pending.length + decoder->length > IMAGE_BUFFER_SIZE) {
+                return false;
+            }
+            memcpy(print->pending.data + print->pending.length, decoder->data, decoder->length);
+            print->pending.length += decoder->length;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    return true;
+}
+
+/// @brief  Decode captured byte received from GB.
+/// @return False if print can't be benchmarked.
+static bool decode_record(PacketDecoder* decoder, const CaptureRecord* record,
+                          CapturedPrint* print) {
+    // Sync word is a single record, packet starts with the next one.
+    if (record->flags & CAPTURE_FLAG_SYNC) {
+        decoder->index = 0;
+        decoder->length = 0;
+        decoder->checksum = 0;
+        return true;
+    }
+    if (decoder->index < 0) {
+        return true;
+    }
+    const uint8_t byte = record->rx;
+
+    // Header and data are covered by checksum.
+    const int index = decoder->index++;
+    if (index < 4 + decoder->length) {
+        decoder->checksum += byte;
+    }
+    if (index == 0) {
+        decoder->command = byte;
+    } else if (index == 1) {
+        decoder->compression = byte;
+    } else if (index == 2) {
+        decoder->length = byte;
+    } else if (index == 3) {
+        decoder->length |= byte << 8;
+        if (decoder->length > IMAGE_BUFFER_SIZE) {
+            decoder->index = -1;
+        }
+    } else if (index < 4 + decoder->length) {
+        decoder->data[index - 4] = byte;
+    } else if (index == 4 + decoder->length) {
+        decoder->received_checksum = byte;
+    } else if (index == 5 + decoder->length) {
+        decoder->received_checksum |= byte << 8;
+        decoder->index = -1;
+        // Packet with wrong checksum is resent by GB.
+        if (decoder->received_checksum == decoder->checksum) {
+            return handle_packet(decoder, print);
+        }
+    }
+    return true;
+}
+
+/// @brief  Load image parts printed in binary link capture.
+/// @return Number of image parts, 0 on failure.
+static int load_capture(const char* path, ImageData* parts) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    CaptureHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "GBLC", 4) != 0 ||
+        header.version != 1 || header.record_size < sizeof(CaptureRecord)) {
+        fprintf(stderr, "%s: not a link capture\n", path);
+        fclose(file);
+        return 0;
+    }
+    if (header.dropped > 0) {
+        fprintf(stderr, "%s: %u records were dropped, print might be incomplete\n", path,
+                header.dropped);
+    }
+
+    PacketDecoder* decoder = calloc(1, sizeof(PacketDecoder));
+    CapturedPrint* print = calloc(1, sizeof(CapturedPrint));
+    uint8_t* record = malloc(header.record_size);
+    bool ok = decoder != NULL && print != NULL && record != NULL;
+    if (ok) {
+        decoder->index = -1;
+        print->parts = parts;
+    }
+    for (uint32_t i = 0; i < header.count && ok; ++i) {
+        ok = fread(record, header.record_size, 1, file) == 1 &&
+             decode_record(decoder, (const CaptureRecord*)record, print);
+    }
+    const int num_parts = ok ? print->num_parts : 0;
+    if (!ok) {
+        fprintf(stderr, "%s: capture is truncated or not supported\n", path);
+    }
+
+    free(record);
+    free(print);
+    free(decoder);
+    fclose(file);
+    return num_parts;
+}
+
+/// @return Hash of published image, 0 if there's none.
+static uint32_t published_hash(void) {
+    const ImageSnapshot* snapshot = image_snapshot_acquire();
+    const uint32_t hash = snapshot != NULL ? snapshot->hash : 0;
+    image_snapshot_release(snapshot);
+    return hash;
+}
+
+int main(int argc, char* argv[]) {
+    if (printer_init() != ESP_OK) {
+        return 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        // Kept until exit, corpus refers to them.
+        ImageData* parts = calloc(MAX_PARTS, sizeof(ImageData));
+        const int num_parts = parts != NULL ? load_capture(argv[i], parts) : 0;
+        if (num_parts == 0 || benchmark_add_print(argv[i], parts, num_parts) != ESP_OK) {
+            fprintf(stderr, "%s: can't be added to corpus\n", argv[i]);
+            return 1;
+        }
+        printf("%s: %d image parts\n", argv[i], num_parts);
+    }
+
+    // Published image of a previous print must survive the benchmark.
+    ImageData* image_data = calloc(1, sizeof(ImageData));
+    if (image_data == NULL) {
+        return 1;
+    }
+    image_data->palette = 0xE4;
+    image_data->length = 0x280;
+    memset(image_data->data, 0x5A, image_data->length);
+    if (image_add_data(image_data) != ESP_OK || image_process() != ESP_OK) {
+        return 1;
+    }
+    free(image_data);
+    const uint32_t hash_before = published_hash();
+
+    char* results = malloc(RESULTS_SIZE);
+    if (results == NULL) {
+        return 1;
+    }
+    const esp_err_t result = benchmark_run(results, RESULTS_SIZE);
+    printf("%s\n", results);
+    free(results);
+
+    int failures = 0;
+    if (result != ESP_OK) {
+        fprintf(stderr, "Benchmark failed: %s\n", esp_err_to_name(result));
+        ++failures;
+    }
+    if (published_hash() != hash_before || image_num_parts() > 0) {
+        fprintf(stderr, "Benchmark changed printer state, image %08x, expected %08x\n",
+                published_hash(), hash_before);
+        ++failures;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+// Link simulator on the development machine. Runs named scenarios, as 'POST /simulate' does,
+// one after another and prints throughput and time to image of each, followed by JSON results.
+//
+//   link_sim [-i byte_interval_us] [scenario...]
+//
+// All scenarios are run if none is given. Bytes are sent as fast as possible by default.
+// Host durations are derived from wall time, compare them only with other host results.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "link_sim.h"
+#include "printer.h"
+
+/// @return Value of integer field of JSON results, -1 if it's missing.
+static int64_t result_field(const char* results, const char* name) {
+    char key[48];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char* value = strstr(results, key);
+    int64_t number = -1;
+    if (value == NULL || sscanf(value + strlen(key), "%" SCNd64, &number) != 1) {
+        return -1;
+    }
+    return number;
+}
+
+/// @brief  Run scenario until it finishes and print its results.
+/// @return True if scenario finished and image was created.
+static bool run_scenario(enum LinkSimScenario scenario, uint32_t byte_interval_us) {
+    const esp_err_t result = link_sim_start(scenario, byte_interval_us);
+    if (result != ESP_OK) {
+        fprintf(stderr, "Scenario can't be started: %s\n", esp_err_to_name(result));
+        return false;
+    }
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while (link_sim_running());
+
+    char results[512];
+    link_sim_format_results(results, sizeof(results));
+    const char* name = strstr(results, "\"scenario\":\"") + strlen("\"scenario\":\"");
+    printf("%-14.*s %8" PRId64 " bytes %8.1f ms link %8" PRId64 " B/s %8.1f ms to image\n",
+           (int)strcspn(name, "\""), name, result_field(results, "bytes"),
+           result_field(results, "link_us") / 1000.0, result_field(results, "throughput_bps"),
+           result_field(results, "time_to_image_us") / 1000.0);
+    printf("%s\n", results);
+    return strstr(results, "\"result\":\"ESP_OK\"") != NULL;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t byte_interval_us = 0;
+    int first_scenario = 1;
+    if (argc > 2 && strcmp(argv[1], "-i") == 0) {
+        byte_interval_us = strtoul(argv[2], NULL, 10);
+        first_scenario = 3;
+    }
+
+    if (printer_init() != ESP_OK) {
+        return 1;
+    }
+
+    int failures = 0;
+    if (first_scenario >= argc) {
+        for (int scenario = 0; scenario < LINK_SIM_NUM_SCENARIOS; ++scenario) {
+            failures += !run_scenario(scenario, byte_interval_us);
+        }
+    }
+    for (int i = first_scenario; i < argc; ++i) {
+        enum LinkSimScenario scenario;
+        if (link_sim_scenario_from_name(argv[i], &scenario) != ESP_OK) {
+            fprintf(stderr, "%s: unknown scenario\n", argv[i]);
+            ++failures;
+            continue;
+        }
+        failures += !run_scenario(scenario, byte_interval_us);
+    }
+    return failures > 0 ? 1 : 0;
+}
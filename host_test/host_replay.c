@@ -0,0 +1,227 @@
+// Replay of binary link captures ('GET /capture') on the development machine. Bytes received
+// from GB are exchanged with the simulated link, paced by capture timestamps, and bytes sent
+// back by the printer are compared with captured ones. Prints hash of the created image and
+// time to image of each capture.
+//
+//   replay [-f] [capture.bin...]
+//
+// With '-f', gaps shorter than a print job timeout are skipped, status polls might see
+// different responses then. Without captures, the "single" link simulator scenario is captured
+// and replayed, the replay must recreate its image.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "image_builder.h"
+#include "link_sim.h"
+#include "printer.h"
+
+// Gaps skipped with '-f', shorter than 500 ms print job timeout.
+#define SKIPPED_GAP_US 100000
+// Max time to wait for image after last byte.
+#define IMAGE_TIMEOUT_MS 10000
+// Number of mismatched responses printed per capture.
+#define MAX_PRINTED_MISMATCHES 10
+
+/// @brief Capture loaded into memory, header followed by records.
+typedef struct {
+    uint8_t* data;
+    size_t length;
+    size_t size;
+} Capture;
+
+/// @brief Replay results.
+typedef struct {
+    uint32_t mismatches;
+    int64_t link_us;
+    int64_t time_to_image_us;
+    // Hash of created image, 0 if there's none.
+    uint32_t image_hash;
+} ReplayResults;
+
+/// @brief 'CaptureWriter' appending to capture in memory.
+static esp_err_t write_capture(const void* data, size_t length, void* ctx) {
+    Capture* capture = ctx;
+    if (capture->length + length > capture->size) {
+        const size_t size = (capture->length + length) * 2;
+        uint8_t* grown = realloc(capture->data, size);
+        if (grown == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        capture->data = grown;
+        capture->size = size;
+    }
+    memcpy(capture->data + capture->length, data, length);
+    capture->length += length;
+    return ESP_OK;
+}
+
+/// @brief  Load binary capture file.
+/// @return Error code.
+static esp_err_t load_capture(const char* path, Capture* capture) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t result = ESP_OK;
+    uint8_t buffer[4096];
+    size_t length;
+    while (result == ESP_OK && (length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        result = write_capture(buffer, length, capture);
+    }
+    fclose(file);
+    return result;
+}
+
+/// @return Header of valid capture, NULL if it's not one.
+static const CaptureHeader* capture_header(const Capture* capture) {
+    const CaptureHeader* header = (const CaptureHeader*)capture->data;
+    if (capture->length < sizeof(CaptureHeader) || memcmp(header->magic, "GBLC", 4) != 0 ||
+        header->version != 1 || header->record_size < sizeof(CaptureRecord) ||
+        capture->length < sizeof(CaptureHeader) + (size_t)header->count * header->record_size) {
+        return NULL;
+    }
+    return header;
+}
+
+/// @brief Wait until given time, sleeping while it's far.
+static void wait_until(int64_t time_us) {
+    const int64_t remaining_us = time_us - esp_timer_get_time();
+    const int64_t kSleepThresholdUs = 20000;
+    if (remaining_us > kSleepThresholdUs) {
+        vTaskDelay(pdMS_TO_TICKS((remaining_us - kSleepThresholdUs / 2) / 1000));
+    }
+    while (esp_timer_get_time() < time_us) {
+        esp_rom_delay_us(1);
+    }
+}
+
+/// @brief      Replay captured bytes as a single link session, then wait for the image.
+/// @param fast Skip gaps shorter than a print job timeout.
+/// @return     Error code.
+static esp_err_t replay(const char* name, const Capture* capture, bool fast,
+                        ReplayResults* results) {
+    const CaptureHeader* header = capture_header(capture);
+    if (header == NULL) {
+        fprintf(stderr, "%s: not a link capture\n", name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header->dropped > 0) {
+        fprintf(stderr, "%s: %u records were dropped, replay starts mid-session\n", name,
+                header->dropped);
+    }
+
+    memset(results, 0, sizeof(ReplayResults));
+    image_png_clear();
+    esp_err_t result = printer_simulation_begin();
+    if (result != ESP_OK) {
+        return result;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    int64_t offset_us = 0;
+    uint32_t previous_timestamp_us = 0;
+    for (uint32_t i = 0; i < header->count; ++i) {
+        const CaptureRecord* record =
+            (const CaptureRecord*)(capture->data + sizeof(CaptureHeader) +
+                                   (size_t)i * header->record_size);
+        // Timestamps are truncated to 32 bits, differences are correct across wraparound.
+        const uint32_t gap_us = i > 0 ? record->timestamp_us - previous_timestamp_us : 0;
+        previous_timestamp_us = record->timestamp_us;
+        if (!fast || gap_us >= SKIPPED_GAP_US) {
+            offset_us += gap_us;
+            wait_until(start_us + offset_us);
+        }
+
+        // Sync word is a single record, its bytes aren't handled as packet bytes.
+        if (record->flags & CAPTURE_FLAG_SYNC) {
+            printer_simulation_exchange(0x88);
+            printer_simulation_exchange(0x33);
+            continue;
+        }
+        const uint8_t received = printer_simulation_exchange(record->rx);
+        if (received != record->tx && results->mismatches++ < MAX_PRINTED_MISMATCHES) {
+            fprintf(stderr, "%s: record %u, sent %02x: got %02x, captured %02x\n", name, i,
+                    record->rx, received, record->tx);
+        }
+    }
+    const int64_t last_byte_us = esp_timer_get_time();
+    results->link_us = last_byte_us - start_us;
+    printer_simulation_end();
+
+    // Wait for image, created once link is idle.
+    for (int elapsed_ms = 0; elapsed_ms < IMAGE_TIMEOUT_MS; elapsed_ms += 10) {
+        const ImageSnapshot* snapshot = image_snapshot_acquire();
+        if (snapshot != NULL) {
+            results->time_to_image_us = esp_timer_get_time() - last_byte_us;
+            results->image_hash = snapshot->hash;
+            image_snapshot_release(snapshot);
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    printf("%s: %u records, %u mismatched responses, link %.1f ms, image %08x after %.1f ms\n",
+           name, header->count, results->mismatches, results->link_us / 1000.0,
+           results->image_hash, results->time_to_image_us / 1000.0);
+    return results->image_hash != 0 ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/// @brief  Capture link simulator scenario and replay it, replay must create the same image.
+/// @return True on success.
+static bool replay_simulation(bool fast) {
+    enum LinkSimScenario scenario;
+    capture_clear();
+    if (link_sim_scenario_from_name("single", &scenario) != ESP_OK ||
+        link_sim_start(scenario, 0) != ESP_OK) {
+        return false;
+    }
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while (link_sim_running());
+
+    const ImageSnapshot* snapshot = image_snapshot_acquire();
+    const uint32_t expected_hash = snapshot != NULL ? snapshot->hash : 0;
+    image_snapshot_release(snapshot);
+    Capture capture = {};
+    ReplayResults results;
+    const bool ok = expected_hash != 0 && capture_export(write_capture, &capture, false) == ESP_OK &&
+                    replay("single", &capture, fast, &results) == ESP_OK &&
+                    results.image_hash == expected_hash;
+    if (!ok) {
+        fprintf(stderr, "Replay of simulation failed, image %08x expected\n", expected_hash);
+    }
+    free(capture.data);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    bool fast = false;
+    int first_capture = 1;
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+        fast = true;
+        first_capture = 2;
+    }
+
+    if (printer_init() != ESP_OK) {
+        return 1;
+    }
+    if (first_capture >= argc) {
+        return replay_simulation(fast) ? 0 : 1;
+    }
+
+    int failures = 0;
+    for (int i = first_capture; i < argc; ++i) {
+        Capture capture = {};
+        ReplayResults results;
+        failures += load_capture(argv[i], &capture) != ESP_OK ||
+                    replay(argv[i], &capture, fast, &results) != ESP_OK;
+        free(capture.data);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+// Round trip of LodePNG compact LZ77 matcher ('encodeLZ77Compact') through the zlib decoder.
+// Host configuration stores PNG data uncompressed, so compact matcher settings are set here,
+// over all window sizes, hash sizes and chain lengths offered by configuration, and with
+// dynamic as well as fixed Huffman coding.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lodepng.h"
+#include "pipeline_heap.h"
+
+// Longer than the largest window, so matching wraps around it.
+#define MAX_LENGTH (96 * 1024)
+// Bitmap row width, rows repeat like in a GB Camera photo.
+#define ROW_LENGTH 160
+
+static const unsigned window_sizes[] = {256, 1024, 4096, 32768};
+static const unsigned hash_bits[] = {8, 11, 16};
+static const unsigned chain_lengths[] = {1, 4, 16, 128};
+static const unsigned block_types[] = {1, 2};
+
+/// @brief Test input.
+typedef struct {
+    const char* name;
+    size_t length;
+    uint8_t* data;
+} Corpus;
+
+/// @return Number of failed round trips.
+static int round_trip(const Corpus* corpus, const LodePNGCompressSettings* settings) {
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+    unsigned error = lodepng_zlib_compress(&compressed, &compressed_length, corpus->data,
+                                           corpus->length, settings);
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+    if (error == 0) {
+        LodePNGDecompressSettings decompress_settings;
+        lodepng_decompress_settings_init(&decompress_settings);
+        error = lodepng_zlib_decompress(&decompressed, &decompressed_length, compressed,
+                                        compressed_length, &decompress_settings);
+    }
+
+    const bool ok =
+        error == 0 && decompressed_length == corpus->length &&
+        (corpus->length == 0 || memcmp(decompressed, corpus->data, corpus->length) == 0);
+    if (!ok) {
+        fprintf(stderr,
+                "%s, %zu bytes: window %u, hash bits %u, chain %u, btype %u: error %u, got %zu "
+                "bytes\n",
+                corpus->name, corpus->length, settings->windowsize, settings->hashbits,
+                settings->maxchainlength, settings->btype, error, decompressed_length);
+    }
+    pipeline_free(compressed);
+    pipeline_free(decompressed);
+    return ok ? 0 : 1;
+}
+
+int main(void) {
+    uint8_t* noise = malloc(MAX_LENGTH);
+    uint8_t* rows = malloc(MAX_LENGTH);
+    uint8_t* zeros = calloc(1, MAX_LENGTH);
+    if (noise == NULL || rows == NULL || zeros == NULL) {
+        return 1;
+    }
+    uint32_t seed = 1;
+    for (size_t i = 0; i < MAX_LENGTH; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        noise[i] = seed >> 24;
+    }
+    // Filtered 2bpp rows - mostly repeated rows, some changed in a few bytes.
+    for (size_t row = 0; row < MAX_LENGTH / ROW_LENGTH; ++row) {
+        uint8_t* data = rows + row * ROW_LENGTH;
+        if (row % 7 == 0) {
+            memcpy(data, noise + row * ROW_LENGTH, ROW_LENGTH);
+        } else {
+            memcpy(data, data - ROW_LENGTH, ROW_LENGTH);
+            data[row % ROW_LENGTH] ^= 0x55;
+        }
+    }
+
+    const Corpus corpora[] = {
+        // Shorter than the 4-byte hash.
+        {"noise", 0, noise},
+        {"noise", 1, noise},
+        {"noise", 3, noise},
+        {"zeros", 4, zeros},
+        {"zeros", 7, zeros},
+        {"noise", 300, noise},
+        // Runs longer than the longest match.
+        {"zeros", 1000, zeros},
+        {"rows", 23040, rows},
+        {"rows", MAX_LENGTH / ROW_LENGTH * ROW_LENGTH, rows},
+        {"noise", MAX_LENGTH, noise},
+        {"zeros", MAX_LENGTH, zeros},
+    };
+
+    int runs = 0;
+    int failures = 0;
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); ++c) {
+        for (size_t w = 0; w < sizeof(window_sizes) / sizeof(window_sizes[0]); ++w) {
+            for (size_t h = 0; h < sizeof(hash_bits) / sizeof(hash_bits[0]); ++h) {
+                for (size_t l = 0; l < sizeof(chain_lengths) / sizeof(chain_lengths[0]); ++l) {
+                    for (size_t b = 0; b < sizeof(block_types) / sizeof(block_types[0]); ++b) {
+                        LodePNGCompressSettings settings;
+                        lodepng_compress_settings_init(&settings);
+                        settings.windowsize = window_sizes[w];
+                        settings.hashbits = hash_bits[h];
+                        settings.maxchainlength = chain_lengths[l];
+                        settings.btype = block_types[b];
+                        failures += round_trip(&corpora[c], &settings);
+                        ++runs;
+                    }
+                }
+            }
+        }
+    }
+
+    free(noise);
+    free(rows);
+    free(zeros);
+    printf("%d round trips, %d failed\n", runs, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+// Single-pass fixed Huffman deflate ('png_deflate_fixed') decoded by LodePNG inflate. Covers
+// inputs shorter than the 4-byte hash, matches of the longest length, 258 bytes, and matches
+// at exactly the window size and beyond it, once positions wrap around the window.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lodepng.h"
+#include "pipeline_heap.h"
+#include "png_deflate.h"
+
+// Longer than the largest window, so positions wrap around it several times.
+#define MAX_LENGTH (3 * 32768 + 1000)
+// Longest deflate match.
+#define MAX_MATCH 258
+// Bits of a fixed Huffman match of the longest length at distance 1 - length code 285 has
+// 8 bits and no extra bits, distance code 0 has 5 bits.
+#define MAX_MATCH_BITS 13
+
+static const unsigned window_sizes[] = {256, 4096, 32768};
+
+/// @brief              Deflate data and inflate it back.
+/// @param deflate_size Output - size of deflate data.
+/// @return             True if inflated data is identical.
+static bool round_trip(const char* name, const uint8_t* data, size_t length,
+                       unsigned window_size, size_t* deflate_size) {
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.windowsize = window_size;
+    settings.hashbits = 11;
+    settings.maxchainlength = 16;
+
+    uint8_t* deflated = NULL;
+    *deflate_size = 0;
+    unsigned error = png_deflate_fixed(&deflated, deflate_size, data, length, &settings);
+    uint8_t* inflated = NULL;
+    size_t inflated_length = 0;
+    if (error == 0) {
+        LodePNGDecompressSettings decompress_settings;
+        lodepng_decompress_settings_init(&decompress_settings);
+        error = lodepng_inflate(&inflated, &inflated_length, deflated, *deflate_size,
+                                &decompress_settings);
+    }
+
+    const bool ok = error == 0 && inflated_length == length &&
+                    (length == 0 || memcmp(inflated, data, length) == 0);
+    if (!ok) {
+        fprintf(stderr, "%s, %zu bytes, window %u: error %u, got %zu bytes\n", name, length,
+                window_size, error, inflated_length);
+    }
+    pipeline_free(deflated);
+    pipeline_free(inflated);
+    return ok;
+}
+
+int main(void) {
+    uint8_t* noise = malloc(MAX_LENGTH);
+    uint8_t* zeros = calloc(1, MAX_LENGTH);
+    uint8_t* repeated = malloc(MAX_LENGTH);
+    if (noise == NULL || zeros == NULL || repeated == NULL) {
+        return 1;
+    }
+    uint32_t seed = 1;
+    for (size_t i = 0; i < MAX_LENGTH; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        noise[i] = seed >> 24;
+    }
+
+    int failures = 0;
+    size_t deflate_size;
+    for (size_t w = 0; w < sizeof(window_sizes) / sizeof(window_sizes[0]); ++w) {
+        const unsigned window_size = window_sizes[w];
+
+        // Shorter than the 4-byte hash, and just above it.
+        for (size_t length = 0; length <= 8; ++length) {
+            failures += !round_trip("noise", noise, length, window_size, &deflate_size);
+            failures += !round_trip("zeros", zeros, length, window_size, &deflate_size);
+        }
+
+        // Runs of longest matches, around multiples of the longest match.
+        for (size_t length = MAX_MATCH - 2; length <= 3 * MAX_MATCH + 2; ++length) {
+            failures += !round_trip("zeros", zeros, length, window_size, &deflate_size);
+        }
+        failures += !round_trip("zeros", zeros, MAX_LENGTH, window_size, &deflate_size);
+        // Longer matches would exceed the bits of the longest one.
+        const size_t max_size = (MAX_LENGTH / MAX_MATCH + 2) * MAX_MATCH_BITS / 8 + 4;
+        if (deflate_size > max_size) {
+            fprintf(stderr, "zeros, window %u: %zu bytes, expected at most %zu\n", window_size,
+                    deflate_size, max_size);
+            ++failures;
+        }
+
+        // Noise repeated at exactly the window size - the farthest match, found at the same
+        // window position once positions wrap around. And beyond the window, out of reach.
+        for (size_t period = window_size; period <= window_size + 1; ++period) {
+            for (size_t i = 0; i < MAX_LENGTH; ++i) {
+                repeated[i] = i < period ? noise[i] : repeated[i - period];
+            }
+            failures += !round_trip("repeated", repeated, MAX_LENGTH, window_size, &deflate_size);
+            const bool compressed = deflate_size < MAX_LENGTH / 2;
+            if (compressed != (period == window_size)) {
+                fprintf(stderr, "repeated every %zu bytes, window %u: %zu bytes\n", period,
+                        window_size, deflate_size);
+                ++failures;
+            }
+        }
+
+        failures += !round_trip("noise", noise, MAX_LENGTH, window_size, &deflate_size);
+    }
+
+    free(noise);
+    free(zeros);
+    free(repeated);
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+// Printer status handshake under load. Simulated GB sends as fast as it can, while image
+// processing and encoding tasks run concurrently. Every scenario must finish without timeouts,
+// received data must never be overwritten, and repeated runs must create identical images.
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "image_builder.h"
+#include "link_sim.h"
+#include "metrics.h"
+#include "printer.h"
+
+/// @brief Scenario run repeatedly.
+typedef struct {
+    const char* name;
+    int runs;
+} StressRun;
+
+static const StressRun stress_runs[] = {
+    // Flow control - printer memory is full several times per print.
+    {"stream", 10},
+    // Checksum errors and retransmissions.
+    {"corrupted", 5},
+    // Prints back to back, printing flag is polled after each.
+    {"print-all", 2},
+};
+
+/// @brief              Run link simulator scenario and wait until it finishes.
+/// @param name         Scenario name.
+/// @param image_hash   Output - hash of created image.
+/// @return             True if scenario finished and image was created.
+static bool run_scenario(const char* name, uint32_t* image_hash) {
+    enum LinkSimScenario scenario;
+    if (link_sim_scenario_from_name(name, &scenario) != ESP_OK ||
+        link_sim_start(scenario, 0) != ESP_OK) {
+        return false;
+    }
+
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while (link_sim_running());
+    char results[512];
+    link_sim_format_results(results, sizeof(results));
+    if (strstr(results, "\"result\":\"ESP_OK\"") == NULL) {
+        fprintf(stderr, "Scenario %s failed: %s\n", name, results);
+        return false;
+    }
+
+    const ImageSnapshot* snapshot = image_snapshot_acquire();
+    *image_hash = snapshot != NULL ? snapshot->hash : 0;
+    image_snapshot_release(snapshot);
+    return snapshot != NULL;
+}
+
+int main(void) {
+    if (printer_init() != ESP_OK) {
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(stress_runs) / sizeof(stress_runs[0]); ++i) {
+        const StressRun* stress_run = &stress_runs[i];
+        uint32_t first_hash = 0;
+        for (int run = 0; run < stress_run->runs; ++run) {
+            uint32_t image_hash = 0;
+            if (!run_scenario(stress_run->name, &image_hash)) {
+                ++failures;
+                continue;
+            }
+            if (run == 0) {
+                first_hash = image_hash;
+            } else if (image_hash != first_hash) {
+                fprintf(stderr, "Scenario %s run %d created image %08x, expected %08x\n",
+                        stress_run->name, run, image_hash, first_hash);
+                ++failures;
+            }
+        }
+        printf("%s: %d runs, image %08x\n", stress_run->name, stress_run->runs, first_hash);
+    }
+
+    // Data received while previous data was still being copied would be dropped.
+    const uint32_t overruns = __atomic_load_n(&metrics_counters[METRICS_RX_OVERRUNS],
+                                              __ATOMIC_RELAXED);
+    if (overruns > 0) {
+        fprintf(stderr, "Receive buffer overruns: %u bytes\n", overruns);
+        ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// Image snapshots shared by concurrent readers while the publisher replaces and removes them.
+// Readers take the current image and kept images of previous jobs by ID. Every acquired
+// snapshot must stay intact until released, and all of them must be freed.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "image_builder.h"
+#include "lodepng.h"
+#include "pipeline_heap.h"
+#include "sdkconfig.h"
+
+#define NUM_READERS 4
+// Image part of a GB Camera photo - 9 packets of two tile rows.
+#define PHOTO_LENGTH (9 * 0x280)
+#define NUM_IMAGES  200
+// Every n-th image repeats the previous print, published image is reused.
+#define REPEAT_EVERY 4
+// Image is removed after every n-th one, as with DELETE '/image'.
+#define CLEAR_EVERY 10
+
+static atomic_bool publishing = true;
+static atomic_uint snapshots_read = 0;
+static atomic_uint corrupted_snapshots = 0;
+
+/// @brief Check data of acquired snapshot and release it.
+static void read_snapshot(const ImageSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    // Freed or overwritten data wouldn't match hash computed once image was published.
+    if (lodepng_crc32(snapshot->data, snapshot->length) != snapshot->hash) {
+        atomic_fetch_add(&corrupted_snapshots, 1);
+    }
+    atomic_fetch_add(&snapshots_read, 1);
+    image_snapshot_release(snapshot);
+}
+
+/// @brief Reader - acquires current and oldest kept snapshot, checks their data and releases
+///        them, repeatedly.
+static void* read_snapshots(void* arg) {
+    while (atomic_load(&publishing)) {
+        read_snapshot(image_snapshot_acquire());
+        uint32_t ids[CONFIG_PRINTER_IMAGE_HISTORY];
+        const size_t num_ids = image_snapshot_ids(ids, CONFIG_PRINTER_IMAGE_HISTORY);
+        if (num_ids > 0) {
+            read_snapshot(image_snapshot_acquire_id(ids[num_ids - 1]));
+        }
+    }
+    return NULL;
+}
+
+/// @brief Fill image part with data unique to the print.
+static void fill_image_data(ImageData* image_data, int print) {
+    image_data->palette = 0xE4;
+    image_data->exposure = 0x40;
+    image_data->length = PHOTO_LENGTH;
+    for (int i = 0; i < image_data->length; ++i) {
+        image_data->data[i] = (i * 31 + print * 7) ^ (i >> 4);
+    }
+}
+
+int main(void) {
+    pthread_t readers[NUM_READERS];
+    for (int i = 0; i < NUM_READERS; ++i) {
+        pthread_create(&readers[i], NULL, read_snapshots, NULL);
+    }
+
+    static ImageData image_data;
+    int failures = 0;
+    int print = 0;
+    // Images expected in history.
+    size_t kept = 0;
+    for (int image = 0; image < NUM_IMAGES; ++image) {
+        const bool repeated = image % REPEAT_EVERY == REPEAT_EVERY - 1;
+        if (!repeated) {
+            ++print;
+        }
+        fill_image_data(&image_data, print);
+        if (image_add_data(&image_data) != ESP_OK || image_process() != ESP_OK) {
+            fprintf(stderr, "Image %d failed\n", image);
+            ++failures;
+            continue;
+        }
+
+        if (repeated) {
+            const ImageSnapshot* snapshot = image_snapshot_acquire();
+            if (snapshot == NULL || atomic_load(&snapshot->copies) != 2) {
+                fprintf(stderr, "Image %d didn't reuse published image\n", image);
+                ++failures;
+            }
+            image_snapshot_release(snapshot);
+        } else if (kept < CONFIG_PRINTER_IMAGE_HISTORY) {
+            ++kept;
+        }
+
+        // Current image is the newest one of history, and all kept ones can be acquired.
+        uint32_t ids[CONFIG_PRINTER_IMAGE_HISTORY];
+        const size_t num_ids = image_snapshot_ids(ids, CONFIG_PRINTER_IMAGE_HISTORY);
+        const ImageSnapshot* current = image_snapshot_acquire();
+        bool history_ok = num_ids == kept && current != NULL && ids[0] == current->hash;
+        image_snapshot_release(current);
+        for (size_t i = 0; i < num_ids && history_ok; ++i) {
+            const ImageSnapshot* snapshot = image_snapshot_acquire_id(ids[i]);
+            history_ok = snapshot != NULL && snapshot->hash == ids[i];
+            image_snapshot_release(snapshot);
+        }
+        if (!history_ok) {
+            fprintf(stderr, "Image %d: %zu kept images, expected %zu\n", image, num_ids, kept);
+            ++failures;
+        }
+
+        if (image % CLEAR_EVERY == CLEAR_EVERY - 1) {
+            image_png_clear();
+            kept = 0;
+        }
+    }
+
+    atomic_store(&publishing, false);
+    for (int i = 0; i < NUM_READERS; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+    image_png_clear();
+
+    // Snapshots are freed with last reference, nothing is left once image is removed.
+    for (int stage = 0; stage < PIPELINE_NUM_STAGES; ++stage) {
+        size_t current = 0;
+        size_t job_peak = 0;
+        pipeline_heap_stats(stage, &current, &job_peak);
+        if (current > 0) {
+            fprintf(stderr, "Stage %s leaked %zu bytes\n", pipeline_stage_name(stage), current);
+            ++failures;
+        }
+    }
+
+    printf("%u snapshots read, %u corrupted\n", atomic_load(&snapshots_read),
+           atomic_load(&corrupted_snapshots));
+    return failures == 0 && atomic_load(&corrupted_snapshots) == 0 ? 0 : 1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/// @return CPU cycles derived from monotonic time, at 'CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ'.
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
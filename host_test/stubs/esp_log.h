@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdio.h>
+
+// Errors and warnings are printed, progress logs are dropped to keep test output short. Dropped
+// logs still consume their arguments, like with logging enabled on device.
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOG_DROP(tag, format, ...)                                      \
+    do {                                                                    \
+        if (0) fprintf(stderr, "%s: " format "\n", tag, ##__VA_ARGS__);     \
+    } while (0)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_DROP(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_DROP(tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_DROP(tag, format, ##__VA_ARGS__)
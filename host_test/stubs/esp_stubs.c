@@ -0,0 +1,89 @@
+#include <time.h>
+#include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+// Free internal RAM of ESP32 once Wi-Fi and web server are running.
+#define HEAP_FREE_SIZE (160 * 1024)
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+    return esp_timer_get_time() * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    const int64_t end_us = esp_timer_get_time() + us;
+    while (esp_timer_get_time() < end_us) {
+    }
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) { return HEAP_FREE_SIZE; }
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) { return HEAP_FREE_SIZE; }
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return HEAP_FREE_SIZE; }
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_start(void) { return ESP_OK; }
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void) { return ESP_OK; }
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void* event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait) {
+    return ESP_OK;
+}
+
+esp_err_t esp_event_isr_post(esp_event_base_t event_base, int32_t event_id,
+                             const void* event_data, size_t event_data_size,
+                             BaseType_t* task_unblocked) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t* config) { return ESP_OK; }
+
+int gpio_get_level(gpio_num_t gpio_num) { return 0; }
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) { return ESP_OK; }
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) { return ESP_OK; }
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) { return ESP_OK; }
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) { return ESP_OK; }
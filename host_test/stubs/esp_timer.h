@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/// @return Monotonic time in microseconds.
+int64_t esp_timer_get_time(void);
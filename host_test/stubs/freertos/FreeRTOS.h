@@ -0,0 +1,43 @@
+#pragma once
+
+// FreeRTOS API used by printer sources, implemented with POSIX threads in 'freertos_stubs.c'.
+// Tasks, timer service and simulated interrupts are threads, scheduling is left to the host.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define portMAX_DELAY        ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS   (1000 / CONFIG_FREERTOS_HZ)
+#define pdMS_TO_TICKS(ms)    ((TickType_t)((uint64_t)(ms) * CONFIG_FREERTOS_HZ / 1000))
+
+typedef struct Task* TaskHandle_t;
+typedef struct Queue* QueueHandle_t;
+typedef struct Timer* TimerHandle_t;
+
+/// @brief Spinlock of critical section, a recursive mutex on host.
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux)      vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)       vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)  vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)   vPortExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)  vPortExitCritical(mux)
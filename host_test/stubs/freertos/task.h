@@ -0,0 +1,40 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+// Timer API is reached through task header by printer sources.
+#include "freertos/timers.h"
+
+typedef void (*TaskFunction_t)(void* arg);
+
+/// @brief Create detached thread running the task. Priority is ignored.
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task);
+
+/// @brief Same as 'xTaskCreate', cores are left to the host.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name,
+                                   uint32_t stack_depth, void* parameters, UBaseType_t priority,
+                                   TaskHandle_t* created_task, BaseType_t core_id);
+
+/// @brief Delete calling task. Only self-deletion with NULL is supported.
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+/// @return Task of calling thread. Threads not created as tasks, e.g., main, get one on first use.
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/// @return Stack size of the task. Stack usage isn't tracked on host.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+/// @return Priority the task was created with, NULL for calling task.
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+
+/// @return Always 0, cores are left to the host.
+BaseType_t xPortGetCoreID(void);
+
+/// @brief Increment notification value of the task.
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+/// @brief  Wait for notification value of calling task to be non-zero.
+/// @return Notification value before it was cleared or decremented. 0 on timeout.
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
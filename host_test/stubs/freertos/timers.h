@@ -0,0 +1,13 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+/// @brief Create timer. Callbacks run in a single timer service thread, as in FreeRTOS.
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t auto_reload,
+                           void* timer_id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t* task_woken);
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+/// @brief Task running in its own thread.
+struct Task {
+    TaskFunction_t code;
+    void* parameters;
+    uint32_t stack_depth;
+    UBaseType_t priority;
+    // Notification value, counted by 'xTaskNotifyGive'.
+    pthread_mutex_t notify_mutex;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+};
+
+/// @brief Queue of fixed size items.
+struct Queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t* items;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+};
+
+/// @brief Software timer, expired by timer service thread.
+struct Timer {
+    TickType_t period;
+    bool auto_reload;
+    TimerCallbackFunction_t callback;
+    bool active;
+    int64_t expiry_us;
+    struct Timer* next;
+};
+
+// Task of calling thread, NULL if thread isn't a task.
+static _Thread_local struct Task* current_task = NULL;
+
+static pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_once_t timer_service_once = PTHREAD_ONCE_INIT;
+static struct Timer* timers = NULL;
+
+static int64_t now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int64_t ticks_to_us(TickType_t ticks) {
+    return (int64_t)ticks * 1000000 / CONFIG_FREERTOS_HZ;
+}
+
+static struct timespec deadline_after(TickType_t ticks) {
+    const int64_t deadline_us = now_us() + ticks_to_us(ticks);
+    const struct timespec deadline = {.tv_sec = deadline_us / 1000000,
+                                      .tv_nsec = deadline_us % 1000000 * 1000};
+    return deadline;
+}
+
+/// @brief  Condition variable waiting on monotonic clock, as deadlines are computed with it.
+static void init_cond(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/// @brief          Wait for condition, mutex must be locked.
+/// @param ticks    Ticks to wait, 'portMAX_DELAY' to wait forever.
+/// @return         False if wait timed out.
+static bool wait_cond(pthread_cond_t* cond, pthread_mutex_t* mutex, TickType_t ticks,
+                      const struct timespec* deadline) {
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        return pthread_cond_wait(cond, mutex) == 0;
+    }
+    return pthread_cond_timedwait(cond, mutex, deadline) == 0;
+}
+
+/// @return New task, NULL if out of memory.
+static struct Task* create_task(TaskFunction_t task_code, uint32_t stack_depth,
+                                void* parameters, UBaseType_t priority) {
+    struct Task* task = calloc(1, sizeof(struct Task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->code = task_code;
+    task->parameters = parameters;
+    task->stack_depth = stack_depth;
+    task->priority = priority;
+    pthread_mutex_init(&task->notify_mutex, NULL);
+    init_cond(&task->notified);
+    return task;
+}
+
+static void delete_task(struct Task* task) {
+    pthread_mutex_destroy(&task->notify_mutex);
+    pthread_cond_destroy(&task->notified);
+    free(task);
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) { pthread_mutex_lock(&mux->mutex); }
+
+void vPortExitCritical(portMUX_TYPE* mux) { pthread_mutex_unlock(&mux->mutex); }
+
+static void* run_task(void* arg) {
+    current_task = arg;
+    current_task->code(current_task->parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task) {
+    struct Task* task = create_task(task_code, stack_depth, parameters, priority);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    const int result = pthread_create(&thread, &attr, run_task, task);
+    pthread_attr_destroy(&attr);
+    if (result != 0) {
+        delete_task(task);
+        return pdFAIL;
+    }
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name,
+                                   uint32_t stack_depth, void* parameters, UBaseType_t priority,
+                                   TaskHandle_t* created_task, BaseType_t core_id) {
+    return xTaskCreate(task_code, name, stack_depth, parameters, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL && current_task != NULL) {
+        delete_task(current_task);
+        current_task = NULL;
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    const int64_t delay_us = ticks_to_us(ticks);
+    const struct timespec delay = {.tv_sec = delay_us / 1000000,
+                                   .tv_nsec = delay_us % 1000000 * 1000};
+    nanosleep(&delay, NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) {
+        // Kept for the lifetime of the thread, which is the whole test for main thread.
+        current_task = create_task(NULL, 0, NULL, 0);
+        if (current_task == NULL) {
+            abort();
+        }
+    }
+    return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (task == NULL) {
+        task = current_task;
+    }
+    return task != NULL ? task->stack_depth : 0;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+BaseType_t xPortGetCoreID(void) { return 0; }
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->notify_mutex);
+    ++task->notify_count;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->notify_mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct Task* task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&task->notify_mutex);
+    while (task->notify_count == 0 &&
+           wait_cond(&task->notified, &task->notify_mutex, ticks_to_wait, &deadline)) {
+    }
+    const uint32_t count = task->notify_count;
+    if (count > 0) {
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->notify_mutex);
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct Queue* queue = calloc(1, sizeof(struct Queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = malloc(length * item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    init_cond(&queue->not_empty);
+    init_cond(&queue->not_full);
+    queue->item_size = item_size;
+    queue->length = length;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+    const struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length) {
+        if (!wait_cond(&queue->not_full, &queue->mutex, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    const size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    ++queue->count;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* task_woken) {
+    if (task_woken != NULL) {
+        *task_woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait) {
+    const struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0) {
+        if (!wait_cond(&queue->not_empty, &queue->mutex, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    memcpy(buffer, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+/// @brief Timer service thread - runs callbacks of expired timers, one at a time.
+static void* timer_service(void* arg) {
+    pthread_mutex_lock(&timer_mutex);
+    for (;;) {
+        struct Timer* expiring = NULL;
+        for (struct Timer* timer = timers; timer != NULL; timer = timer->next) {
+            if (timer->active && (expiring == NULL || timer->expiry_us < expiring->expiry_us)) {
+                expiring = timer;
+            }
+        }
+        if (expiring == NULL) {
+            pthread_cond_wait(&timer_cond, &timer_mutex);
+            continue;
+        }
+        const int64_t now = now_us();
+        if (expiring->expiry_us > now) {
+            const struct timespec deadline = {.tv_sec = expiring->expiry_us / 1000000,
+                                              .tv_nsec = expiring->expiry_us % 1000000 * 1000};
+            pthread_cond_timedwait(&timer_cond, &timer_mutex, &deadline);
+            continue;
+        }
+
+        if (expiring->auto_reload) {
+            expiring->expiry_us = now + ticks_to_us(expiring->period);
+        } else {
+            expiring->active = false;
+        }
+        pthread_mutex_unlock(&timer_mutex);
+        expiring->callback(expiring);
+        pthread_mutex_lock(&timer_mutex);
+    }
+    return NULL;
+}
+
+static void start_timer_service(void) {
+    init_cond(&timer_cond);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_service, NULL) != 0) {
+        abort();
+    }
+    pthread_detach(thread);
+}
+
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t auto_reload,
+                           void* timer_id, TimerCallbackFunction_t callback) {
+    pthread_once(&timer_service_once, start_timer_service);
+    struct Timer* timer = calloc(1, sizeof(struct Timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->callback = callback;
+
+    pthread_mutex_lock(&timer_mutex);
+    timer->next = timers;
+    timers = timer;
+    pthread_mutex_unlock(&timer_mutex);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    return xTimerReset(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&timer_mutex);
+    timer->active = false;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_mutex);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&timer_mutex);
+    timer->active = true;
+    timer->expiry_us = now_us() + ticks_to_us(timer->period);
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_mutex);
+    return pdPASS;
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t* task_woken) {
+    if (task_woken != NULL) {
+        *task_woken = pdFALSE;
+    }
+    return xTimerReset(timer, 0);
+}
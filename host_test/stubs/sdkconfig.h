@@ -0,0 +1,26 @@
+#pragma once
+
+// Host test configuration. Mirrors project defaults in 'sdkconfig', link simulator is enabled
+// to drive the printer like a GB would, benchmark for 'host_benchmark', link capture for
+// 'replay'. PNG CRC is computed by LodePNG, there's no ROM.
+
+#define CONFIG_FREERTOS_HZ              100
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+
+#define CONFIG_GPIO_DETECT 16
+#define CONFIG_GPIO_TX     4
+#define CONFIG_GPIO_RX     12
+#define CONFIG_GPIO_CLOCK  17
+
+#define CONFIG_PRINTER_HEAP_BUDGET_KB      128
+#define CONFIG_PRINTER_IMAGE_HISTORY       4
+#define CONFIG_PRINTER_PIPELINE_ARENA_KB   64
+#define CONFIG_PRINTER_PNG_FILTER_NONE     1
+#define CONFIG_PRINTER_PNG_LZ77_WINDOW     4096
+#define CONFIG_PRINTER_PNG_LZ77_HASH_BITS  11
+#define CONFIG_PRINTER_PNG_LZ77_CHAIN      16
+#define CONFIG_PRINTER_PNG_COMPRESSION_NONE 1
+#define CONFIG_PRINTER_LINK_SIMULATOR      1
+#define CONFIG_PRINTER_BENCHMARK           1
+#define CONFIG_PRINTER_CAPTURE             1
+#define CONFIG_PRINTER_CAPTURE_SIZE        8192
@@ -0,0 +1,66 @@
+// Turbo mode comparison - GB Camera "print all" with turbo mode off, then on. GB waits until
+// printing is seen, then cleared. In turbo mode, status of every print command must report
+// printing and every print must finish that way, cutting the time GB spends polling.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "link_sim.h"
+#include "printer.h"
+
+/// @return Value of integer field of JSON results, -1 if it's missing.
+static int64_t result_field(const char* results, const char* name) {
+    char key[48];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char* value = strstr(results, key);
+    int64_t number = -1;
+    if (value == NULL || sscanf(value + strlen(key), "%" SCNd64, &number) != 1) {
+        return -1;
+    }
+    return number;
+}
+
+int main(void) {
+    // Prints of GB Camera "print all".
+    const int64_t kPrints = 30;
+    enum LinkSimScenario scenario;
+    if (printer_init() != ESP_OK ||
+        link_sim_scenario_from_name("turbo-compare", &scenario) != ESP_OK ||
+        link_sim_start(scenario, 0) != ESP_OK) {
+        return 1;
+    }
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while (link_sim_running());
+
+    char results[512];
+    link_sim_format_results(results, sizeof(results));
+    if (strstr(results, "\"result\":\"ESP_OK\"") == NULL) {
+        fprintf(stderr, "Scenario failed: %s\n", results);
+        return 1;
+    }
+
+    const int64_t off_link_us = result_field(results, "turbo_off_link_us");
+    const int64_t off_wait_us = result_field(results, "turbo_off_print_wait_us");
+    const int64_t on_link_us = result_field(results, "link_us");
+    const int64_t on_wait_us = result_field(results, "print_wait_us");
+    const int64_t off_finished = result_field(results, "turbo_off_prints_finished");
+    const int64_t on_acks = result_field(results, "print_acks");
+    const int64_t on_finished = result_field(results, "prints_finished");
+    const int64_t on_timeouts = result_field(results, "print_start_timeouts");
+    printf("turbo off: link %" PRId64 " us, print wait %" PRId64 " us, %" PRId64
+           " prints finished\n",
+           off_link_us, off_wait_us, off_finished);
+    printf("turbo on:  link %" PRId64 " us, print wait %" PRId64 " us, %" PRId64
+           " prints finished, %" PRId64 " acknowledged, %" PRId64 " start timeouts\n",
+           on_link_us, on_wait_us, on_finished, on_acks, on_timeouts);
+
+    // Status sequence of every print - acknowledged as printing, then cleared.
+    if (on_acks != kPrints || on_finished != kPrints || on_timeouts != 0) {
+        fprintf(stderr, "Turbo mode prints weren't seen printing, then finished\n");
+        return 1;
+    }
+    return on_wait_us >= 0 && on_wait_us < off_wait_us && on_link_us < off_link_us ? 0 : 1;
+}
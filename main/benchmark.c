@@ -0,0 +1,809 @@
+#include "benchmark.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "image_builder.h"
+#include "lodepng.h"
+#include "pipeline_heap.h"
+#include "png_deflate.h"
+#include "printer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PRINTER_BENCHMARK
+
+static const char* TAG = "BENCHMARK";
+
+// Image part of a single GB Camera photo - 160x144 pixels.
+#define PART_LENGTH   0x1680
+#define PART_HEIGHT   144
+#define PART_WIDTH    160
+#define TILES_PER_ROW (PART_WIDTH / 8)
+// Number of measured runs of palette lookup table creation.
+#define PALETTE_ITERATIONS 1000
+// Number of measured runs of bitmap creation, encoding and packet handling.
+#define ITERATIONS 5
+// Number of simulated print jobs for heap fragmentation measurement.
+#define FRAGMENTATION_JOBS 1000
+// Size of a full data packet.
+#define PACKET_DATA_SIZE 0x280
+// Packet bytes other than data - sync word, header, checksum, acknowledgement and status.
+#define FRAMING_SIZE 10
+#define CPU_MHZ          CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+// Stack of benchmark task. Benchmark runs the whole encoder, like image encoding task does, so
+// it gets the same stack.
+#define TASK_STACK_SIZE 16384
+// Unused stack of benchmark task is reported once it drops below this size.
+#define TASK_STACK_MARGIN 2048
+// Max number of captured prints in the corpus.
+#define MAX_PRINTS 8
+
+/// @brief Synthetic image content.
+enum Pattern {
+    /// @brief All pixels white.
+    PATTERN_BLANK,
+    /// @brief Random pixels - worst case for compression.
+    PATTERN_NOISE,
+    /// @brief Dithered gradient, resembling GB Camera photo.
+    PATTERN_PHOTO,
+    /// @brief Large blocks in bands 4 pixels tall, resembling banner text - most rows repeat.
+    PATTERN_BANNER
+};
+
+/// @brief Deflate methods compared on each corpus entry.
+enum CompressionMethod {
+    /// @brief Stored blocks.
+    COMPRESSION_STORED,
+    /// @brief Stock LodePNG LZ77 matcher with default window and dynamic Huffman coding.
+    COMPRESSION_STOCK,
+    /// @brief Compact LZ77 matcher with configured window, hash and chain length.
+    COMPRESSION_COMPACT,
+    /// @brief Single-pass compact LZ77 with fixed Huffman codes.
+    COMPRESSION_FIXED,
+    NUM_COMPRESSION_METHODS
+};
+
+static const char* compression_names[NUM_COMPRESSION_METHODS] = {
+    [COMPRESSION_STORED] = "stored",
+    [COMPRESSION_STOCK] = "stock",
+    [COMPRESSION_COMPACT] = "compact",
+    [COMPRESSION_FIXED] = "fixed",
+};
+
+static const char* filter_names[IMAGE_NUM_FILTERS] = {
+    [IMAGE_FILTER_AUTO] = "auto",
+    [IMAGE_FILTER_NONE] = "none",
+    [IMAGE_FILTER_UP] = "up",
+    [IMAGE_FILTER_REPEATED_ROWS] = "repeated_rows",
+    [IMAGE_FILTER_CONTENT] = "content",
+};
+
+static const char* content_names[IMAGE_NUM_CONTENT_CLASSES] = {
+    [IMAGE_CONTENT_BLANK] = "blank",
+    [IMAGE_CONTENT_PHOTO] = "photo",
+    [IMAGE_CONTENT_REPEATED_ROWS] = "repeated_rows",
+};
+
+/// @brief Benchmark corpus entry.
+typedef struct {
+    const char* name;
+    enum Pattern pattern;
+    int num_parts;
+    // Image parts of captured print, NULL for synthetic ones.
+    const ImageData* parts;
+} BenchmarkCase;
+
+static const BenchmarkCase cases[] = {
+    {"blank", PATTERN_BLANK, 1, NULL},
+    {"noise", PATTERN_NOISE, 1, NULL},
+    {"photo", PATTERN_PHOTO, 1, NULL},
+    {"photo-strip", PATTERN_PHOTO, 2, NULL},
+    {"banner", PATTERN_BANNER, 2, NULL},
+};
+
+// Captured prints, benchmarked after synthetic ones.
+static BenchmarkCase prints[MAX_PRINTS];
+static int num_prints = 0;
+
+/// @brief Results of a single encoder variant. Durations are averaged over iterations.
+typedef struct {
+    esp_err_t result;
+    uint32_t encode_cycles;
+    size_t png_length;
+    size_t peak_heap;
+} EncodeResult;
+
+/// @brief Results of a single corpus entry. Durations are averaged over iterations.
+typedef struct {
+    uint32_t height_px;
+    uint32_t tiles;
+    uint32_t unique_tiles;
+    // Content class, choosing filter of 'IMAGE_FILTER_CONTENT'.
+    enum ImageContent content;
+    // Heap used by stored image parts.
+    size_t parts_bytes;
+    uint32_t palette_cycles;
+    uint32_t bitmap_cycles;
+    uint32_t encode_cycles;
+    uint32_t process_cycles;
+    // Processing of identical job, reusing published image.
+    uint32_t repeat_process_cycles;
+    size_t png_length;
+    size_t peak_heap;
+    size_t arena_peak;
+    EncodeResult compression[NUM_COMPRESSION_METHODS];
+    EncodeResult filters[IMAGE_NUM_FILTERS];
+} BenchmarkResult;
+
+/// @brief Heap state after a series of print jobs.
+typedef struct {
+    size_t arena_size;
+    size_t free_before;
+    size_t free_after;
+    size_t largest_block_before;
+    size_t largest_block_after;
+    // Smallest largest free block seen between jobs.
+    size_t largest_block_min;
+} FragmentationResult;
+
+/// @brief Results of PNG chunk CRC. Durations are averaged over iterations.
+typedef struct {
+    // Matches reference implementation.
+    bool verified;
+    uint32_t cycles;
+    uint32_t reference_cycles;
+} CrcResult;
+
+/// @brief Results of zlib stored-block compression, dominated by Adler-32.
+///        Durations are averaged over iterations.
+typedef struct {
+    // Adler-32 in zlib trailer matches reference implementation.
+    bool verified;
+    uint32_t cycles;
+    uint32_t reference_cycles;
+} AdlerResult;
+
+/// @brief Results of link protocol handling. Durations are averaged over iterations.
+typedef struct {
+    uint32_t data_packet_cycles;
+    uint32_t status_packet_cycles;
+} ProtocolResult;
+
+/// @brief Benchmark task parameters.
+typedef struct {
+    char* buffer;
+    size_t size;
+    esp_err_t result;
+    TaskHandle_t caller;
+} BenchmarkRun;
+
+static bool running = false;
+
+/// @brief  Get shade of synthetic photo pixel - radial gradient with ordered dithering.
+/// @return 2-bit GB color, 0 is the lightest.
+static uint8_t photo_shade(uint32_t x, uint32_t y) {
+    static const uint8_t kBayer[4][4] = {
+        {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+    const int32_t dx = (int32_t)x - PART_WIDTH / 2;
+    const int32_t dy = (int32_t)(y % PART_HEIGHT) - PART_HEIGHT / 2;
+    // Level in range 0-48, darker towards the edges.
+    const uint32_t kMaxDistance = (PART_WIDTH / 2) * (PART_WIDTH / 2) +
+                                  (PART_HEIGHT / 2) * (PART_HEIGHT / 2);
+    const uint32_t level = (dx * dx + dy * dy) * 48 / kMaxDistance;
+    return (level + kBayer[y % 4][x % 4]) / 16;
+}
+
+/// @brief Fill image data with synthetic tile data.
+static void fill_part(ImageData* image_data, enum Pattern pattern, int part, uint32_t* seed) {
+    image_data->number_of_sheets = 1;
+    image_data->margins = 0;
+    image_data->palette = 0xE4;
+    image_data->exposure = 0x40;
+    image_data->length = PART_LENGTH;
+
+    for (uint32_t i = 0; i < PART_LENGTH; i += 2) {
+        const uint32_t tile = i / 16;
+        const uint32_t x_px = (tile % TILES_PER_ROW) * 8;
+        const uint32_t y_px = part * PART_HEIGHT + (tile / TILES_PER_ROW) * 8 + (i % 16) / 2;
+        uint8_t low_byte = 0;
+        uint8_t high_byte = 0;
+        switch (pattern) {
+            case PATTERN_BLANK: {
+                break;
+            }
+            case PATTERN_NOISE: {
+                *seed = *seed * 1664525 + 1013904223;
+                low_byte = *seed >> 24;
+                high_byte = *seed >> 16;
+                break;
+            }
+            case PATTERN_PHOTO: {
+                // Most significant bit is the leftmost pixel.
+                for (int b = 7; b >= 0; --b) {
+                    const uint8_t shade = photo_shade(x_px + 7 - b, y_px);
+                    low_byte |= (shade & 0x01) << b;
+                    high_byte |= (shade >> 1) << b;
+                }
+                break;
+            }
+            case PATTERN_BANNER: {
+                for (int b = 7; b >= 0; --b) {
+                    const uint8_t shade = ((x_px + 7 - b) / 16 + y_px / 4) % 4;
+                    low_byte |= (shade & 0x01) << b;
+                    high_byte |= (shade >> 1) << b;
+                }
+                break;
+            }
+        }
+        image_data->data[i] = low_byte;
+        image_data->data[i + 1] = high_byte;
+    }
+}
+
+/// @brief Load image part of corpus entry.
+static void load_part(const BenchmarkCase* info, int part, ImageData* image_data, uint32_t* seed) {
+    if (info->parts != NULL) {
+        memcpy(image_data, &info->parts[part], sizeof(ImageData));
+    } else {
+        fill_part(image_data, info->pattern, part, seed);
+    }
+}
+
+/// @brief Encode bitmap with given options. Failures, e.g., out of memory, are recorded.
+static void measure_encode(const uint8_t* bitmap, uint32_t px_height,
+                           const ImageEncodeOptions* options, EncodeResult* result) {
+    memset(result, 0, sizeof(EncodeResult));
+    const size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_start();
+    for (int i = 0; i < ITERATIONS && result->result == ESP_OK; ++i) {
+        const esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+        result->result = image_benchmark_encode(bitmap, px_height, options, &result->png_length);
+        result->encode_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    }
+    result->peak_heap = free_before - heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    result->encode_cycles /= ITERATIONS;
+}
+
+/// @brief Encode bitmap with each deflate method, using configured filter.
+static void run_compression(const uint8_t* bitmap, uint32_t px_height, EncodeResult results[]) {
+    for (int method = 0; method < NUM_COMPRESSION_METHODS; ++method) {
+        ImageEncodeOptions options;
+        image_benchmark_encode_options(&options);
+        LodePNGCompressSettings* settings = &options.compression;
+        settings->btype = method == COMPRESSION_STORED ? 0 : 2;
+        settings->custom_deflate = NULL;
+        if (method == COMPRESSION_FIXED) {
+            settings->btype = 1;
+            settings->custom_deflate = png_deflate_fixed;
+        } else if (method == COMPRESSION_STOCK) {
+            LodePNGCompressSettings defaults;
+            lodepng_compress_settings_init(&defaults);
+            settings->windowsize = defaults.windowsize;
+            settings->hashbits = 0;
+        }
+        measure_encode(bitmap, px_height, &options, &results[method]);
+    }
+}
+
+/// @brief Encode bitmap with each filter strategy. Stored blocks don't depend on filters,
+///        so compact LZ77 with dynamic Huffman coding is used.
+static void run_filters(const uint8_t* bitmap, uint32_t px_height, EncodeResult results[]) {
+    for (int filter = 0; filter < IMAGE_NUM_FILTERS; ++filter) {
+        ImageEncodeOptions options;
+        image_benchmark_encode_options(&options);
+        options.compression.btype = 2;
+        options.compression.custom_deflate = NULL;
+        options.filter = filter;
+        measure_encode(bitmap, px_height, &options, &results[filter]);
+    }
+}
+
+/// @brief Store image parts of corpus entry in print job, as printer does.
+static esp_err_t add_parts(const BenchmarkCase* info, ImageData* image_data, ImageJob* job,
+                           uint32_t seed) {
+    for (int part = 0; part < info->num_parts; ++part) {
+        load_part(info, part, image_data, &seed);
+        ESP_ERROR_RETURN(image_benchmark_add_data(job, image_data));
+    }
+    return ESP_OK;
+}
+
+/// @brief Measure stages and whole processing of print job of corpus entry.
+static esp_err_t measure_job(const BenchmarkCase* info, ImageData* image_data, ImageJob* job,
+                             BenchmarkResult* result) {
+    // Store image parts, as printer does.
+    ESP_ERROR_RETURN(add_parts(info, image_data, job, 1));
+    size_t parts_peak;
+    pipeline_heap_stats(PIPELINE_STAGE_PARTS, &result->parts_bytes, &parts_peak);
+    result->unique_tiles = image_benchmark_unique_tiles(job);
+
+    // Palette lookup table.
+    esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+    for (int i = 0; i < PALETTE_ITERATIONS; ++i) {
+        image_benchmark_palette(image_data);
+    }
+    result->palette_cycles = (esp_cpu_get_cycle_count() - start_cycles) / PALETTE_ITERATIONS;
+
+    // Bitmap. Last one is kept for encoding.
+    uint8_t* bitmap = NULL;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        pipeline_free(bitmap);
+        start_cycles = esp_cpu_get_cycle_count();
+        esp_err_t bitmap_result = image_benchmark_bitmap(job, &bitmap, &result->height_px);
+        result->bitmap_cycles += esp_cpu_get_cycle_count() - start_cycles;
+        ESP_ERROR_RETURN(bitmap_result);
+    }
+    result->bitmap_cycles /= ITERATIONS;
+    result->tiles = result->height_px / 8 * TILES_PER_ROW;
+    result->content = image_benchmark_content(bitmap, result->height_px);
+
+    // PNG encoding.
+    esp_err_t encode_result = ESP_OK;
+    for (int i = 0; i < ITERATIONS && encode_result == ESP_OK; ++i) {
+        start_cycles = esp_cpu_get_cycle_count();
+        encode_result =
+            image_benchmark_encode(bitmap, result->height_px, NULL, &result->png_length);
+        result->encode_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    }
+    if (encode_result == ESP_OK) {
+        run_compression(bitmap, result->height_px, result->compression);
+        run_filters(bitmap, result->height_px, result->filters);
+    }
+    pipeline_free(bitmap);
+    ESP_ERROR_RETURN(encode_result);
+    result->encode_cycles /= ITERATIONS;
+
+    // Whole image processing, as done once image timeout expires.
+    // Peak heap usage is the drop of minimum free heap size during processing.
+    uint8_t* png = NULL;
+    size_t png_length;
+    const size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    ESP_ERROR_RETURN(heap_caps_monitor_local_minimum_free_size_start());
+    start_cycles = esp_cpu_get_cycle_count();
+    esp_err_t process_result = image_benchmark_process(job, &png, &png_length);
+    result->process_cycles = esp_cpu_get_cycle_count() - start_cycles;
+    result->peak_heap = free_before - heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    size_t arena_size;
+    pipeline_arena_stats(&arena_size, &result->arena_peak);
+    pipeline_free(png);
+    return process_result;
+}
+
+static esp_err_t run_case(const BenchmarkCase* info, ImageData* image_data,
+                          BenchmarkResult* result) {
+    memset(result, 0, sizeof(BenchmarkResult));
+
+    // Benchmark jobs are built apart from received image parts and never published.
+    ImageJob* job = image_benchmark_job_create();
+    if (job == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t case_result = measure_job(info, image_data, job, result);
+
+    // Identical job, as if print was repeated - only compared with processed one.
+    ImageJob* repeated_job = case_result == ESP_OK ? image_benchmark_job_create() : NULL;
+    if (case_result == ESP_OK && repeated_job == NULL) {
+        case_result = ESP_ERR_NO_MEM;
+    }
+    if (case_result == ESP_OK) {
+        case_result = add_parts(info, image_data, repeated_job, 1);
+    }
+    if (case_result == ESP_OK) {
+        const esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+        const bool same = image_benchmark_same_content(repeated_job, job);
+        result->repeat_process_cycles = esp_cpu_get_cycle_count() - start_cycles;
+        case_result = same ? ESP_OK : ESP_FAIL;
+    }
+    image_benchmark_job_free(repeated_job);
+    image_benchmark_job_free(job);
+    return case_result;
+}
+
+/// @brief  Process print jobs over the whole corpus and track largest free heap block.
+///         Compare builds with and without job arena to see its effect on fragmentation.
+static esp_err_t run_fragmentation(ImageData* image_data, FragmentationResult* result) {
+    memset(result, 0, sizeof(FragmentationResult));
+    result->free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    result->largest_block_before = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    result->largest_block_min = result->largest_block_before;
+
+    // Last job and its image are kept until next one is processed, as published image is.
+    ImageJob* kept_job = NULL;
+    uint8_t* kept_png = NULL;
+    esp_err_t jobs_result = ESP_OK;
+    const size_t num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < FRAGMENTATION_JOBS && jobs_result == ESP_OK; ++i) {
+        ImageJob* job = image_benchmark_job_create();
+        if (job == NULL) {
+            jobs_result = ESP_ERR_NO_MEM;
+            break;
+        }
+        uint8_t* png = NULL;
+        size_t png_length;
+        jobs_result = add_parts(&cases[i % num_cases], image_data, job, i + 1);
+        if (jobs_result == ESP_OK) {
+            jobs_result = image_benchmark_process(job, &png, &png_length);
+        }
+        image_benchmark_job_free(kept_job);
+        pipeline_free(kept_png);
+        kept_job = job;
+        kept_png = png;
+
+        const size_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        if (largest_block < result->largest_block_min) {
+            result->largest_block_min = largest_block;
+        }
+    }
+
+    size_t arena_peak;
+    pipeline_arena_stats(&result->arena_size, &arena_peak);
+    result->free_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    result->largest_block_after = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    image_benchmark_job_free(kept_job);
+    pipeline_free(kept_png);
+    return jobs_result;
+}
+
+/// @brief Bytewise CRC-32 with 16-entry table, as suggested by LodePNG.
+static uint32_t reference_crc32(const uint8_t* data, size_t length) {
+    static const uint32_t kTable[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+        0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--) {
+        crc = kTable[(crc ^ *data) & 0xF] ^ (crc >> 4);
+        crc = kTable[(crc ^ (*data >> 4)) & 0xF] ^ (crc >> 4);
+        ++data;
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void run_crc(ImageData* image_data, CrcResult* result) {
+    memset(result, 0, sizeof(CrcResult));
+    uint32_t seed = 1;
+    fill_part(image_data, PATTERN_NOISE, 0, &seed);
+
+    // Check value of CRC-32, then all lengths up to 64 bytes to cover unaligned tails.
+    result->verified = lodepng_crc32((const uint8_t*)"123456789", 9) == 0xCBF43926;
+    for (size_t length = 0; length <= 64 && result->verified; ++length) {
+        result->verified = lodepng_crc32(image_data->data + 1, length) ==
+                           reference_crc32(image_data->data + 1, length);
+    }
+
+    uint32_t crc = 0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+        crc = lodepng_crc32(image_data->data, PART_LENGTH);
+        result->cycles += esp_cpu_get_cycle_count() - start_cycles;
+
+        start_cycles = esp_cpu_get_cycle_count();
+        const uint32_t reference = reference_crc32(image_data->data, PART_LENGTH);
+        result->reference_cycles += esp_cpu_get_cycle_count() - start_cycles;
+        result->verified = result->verified && crc == reference;
+    }
+    result->cycles /= ITERATIONS;
+    result->reference_cycles /= ITERATIONS;
+}
+
+/// @brief Bytewise Adler-32, as defined by RFC 1950.
+static uint32_t reference_adler32(const uint8_t* data, size_t length) {
+    uint32_t s1 = 1;
+    uint32_t s2 = 0;
+    for (size_t i = 0; i < length; ++i) {
+        s1 = (s1 + data[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    return s2 << 16 | s1;
+}
+
+/// @brief  Compress data as zlib stream with stored blocks, as PNG encoder does.
+/// @return Adler-32 from zlib trailer, 0 on failure.
+static uint32_t zlib_stored_adler32(const uint8_t* data, size_t length) {
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.btype = 0;
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    uint32_t adler = 0;
+    if (lodepng_zlib_compress(&out, &out_length, data, length, &settings) == 0) {
+        const uint8_t* trailer = out + out_length - 4;
+        adler = (uint32_t)trailer[0] << 24 | trailer[1] << 16 | trailer[2] << 8 | trailer[3];
+    }
+    pipeline_free(out);
+    return adler;
+}
+
+static void run_adler(ImageData* image_data, AdlerResult* result) {
+    memset(result, 0, sizeof(AdlerResult));
+    uint32_t seed = 1;
+    fill_part(image_data, PATTERN_NOISE, 0, &seed);
+
+    // All lengths up to 64 bytes cover unrolled loop tail. Whole part spans two sum blocks.
+    result->verified = true;
+    for (size_t length = 0; length <= 64 && result->verified; ++length) {
+        result->verified = zlib_stored_adler32(image_data->data + 1, length) ==
+                           reference_adler32(image_data->data + 1, length);
+    }
+
+    for (int i = 0; i < ITERATIONS; ++i) {
+        esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+        const uint32_t adler = zlib_stored_adler32(image_data->data, PART_LENGTH);
+        result->cycles += esp_cpu_get_cycle_count() - start_cycles;
+
+        start_cycles = esp_cpu_get_cycle_count();
+        const uint32_t reference = reference_adler32(image_data->data, PART_LENGTH);
+        result->reference_cycles += esp_cpu_get_cycle_count() - start_cycles;
+        result->verified = result->verified && adler == reference;
+    }
+    result->cycles /= ITERATIONS;
+    result->reference_cycles /= ITERATIONS;
+}
+
+/// @brief  Send single packet through printer protocol handling.
+/// @return Duration in CPU cycles.
+static uint32_t exchange_packet(uint8_t command, const uint8_t* data, uint16_t length) {
+    const esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+    printer_simulation_exchange(0x88);
+    printer_simulation_exchange(0x33);
+    const uint8_t header[] = {command, 0x00, length & 0xFF, length >> 8};
+    uint16_t checksum = 0;
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        printer_simulation_exchange(header[i]);
+        checksum += header[i];
+    }
+    for (uint16_t i = 0; i < length; ++i) {
+        printer_simulation_exchange(data[i]);
+        checksum += data[i];
+    }
+    printer_simulation_exchange(checksum & 0xFF);
+    printer_simulation_exchange(checksum >> 8);
+    printer_simulation_exchange(0x00);
+    printer_simulation_exchange(0x00);
+    return esp_cpu_get_cycle_count() - start_cycles;
+}
+
+static esp_err_t run_protocol(ImageData* image_data, ProtocolResult* result) {
+    memset(result, 0, sizeof(ProtocolResult));
+    fill_part(image_data, PATTERN_PHOTO, 0, NULL);
+
+    for (int i = 0; i < ITERATIONS; ++i) {
+        // Initialize first, so data never exceeds printer buffer.
+        exchange_packet(0x01, NULL, 0);
+        result->data_packet_cycles += exchange_packet(0x04, image_data->data, PACKET_DATA_SIZE);
+        result->status_packet_cycles += exchange_packet(0x0F, NULL, 0);
+    }
+    // Leave printer without data.
+    exchange_packet(0x01, NULL, 0);
+
+    result->data_packet_cycles /= ITERATIONS;
+    result->status_packet_cycles /= ITERATIONS;
+    return ESP_OK;
+}
+
+/// @brief  Format results of encoder variants as JSON object member.
+/// @return Length of whole output, including truncated part.
+static size_t format_encode(char* buffer, size_t size, size_t length, const char* key,
+                            const char* names[], const EncodeResult results[], int count) {
+    size_t offset = length < size ? length : size;
+    length += snprintf(buffer + offset, size - offset, ",\"%s\":{", key);
+    for (int i = 0; i < count; ++i) {
+        offset = length < size ? length : size;
+        length += snprintf(buffer + offset, size - offset,
+                           "%s\"%s\":{\"ok\":%s,\"encode_cycles\":%lu,\"png_bytes\":%u,"
+                           "\"peak_heap_bytes\":%u}",
+                           i == 0 ? "" : ",", names[i],
+                           results[i].result == ESP_OK ? "true" : "false",
+                           results[i].encode_cycles, results[i].png_length, results[i].peak_heap);
+    }
+    offset = length < size ? length : size;
+    return length + snprintf(buffer + offset, size - offset, "}");
+}
+
+/// @brief  Get throughput in MB/s - bytes per microsecond.
+static float throughput(uint32_t bytes, uint32_t cycles) {
+    return cycles > 0 ? (float)bytes * CPU_MHZ / cycles : 0;
+}
+
+static size_t format_case(char* buffer, size_t size, size_t length, bool first,
+                          const BenchmarkCase* info, const BenchmarkResult* result) {
+    size_t offset = length < size ? length : size;
+    // Bitmap throughput is given for produced bitmap, encoding throughput for consumed one.
+    const uint32_t bitmap_length = result->height_px * PART_WIDTH;
+    length += snprintf(buffer + offset, size - offset,
+                       "%s{\"name\":\"%s\",\"parts\":%d,\"height_px\":%lu,\"tiles\":%lu,"
+                       "\"unique_tiles\":%lu,\"content_class\":\"%s\",\"parts_bytes\":%u,"
+                       "\"palette_cycles\":%lu,"
+                       "\"bitmap_cycles\":%lu,\"bitmap_ns_per_tile\":%lu,"
+                       "\"bitmap_mb_s\":%.2f,\"encode_cycles\":%lu,\"encode_mb_s\":%.2f,"
+                       "\"process_cycles\":%lu,\"process_us\":%lu,\"repeat_process_cycles\":%lu,"
+                       "\"png_bytes\":%u,\"peak_heap_bytes\":%u,\"arena_peak_bytes\":%u",
+                       first ? "" : ",", info->name, info->num_parts,
+                       result->height_px, result->tiles, result->unique_tiles,
+                       content_names[result->content], result->parts_bytes, result->palette_cycles,
+                       result->bitmap_cycles,
+                       (uint32_t)((uint64_t)result->bitmap_cycles * 1000 / CPU_MHZ / result->tiles),
+                       throughput(bitmap_length, result->bitmap_cycles), result->encode_cycles,
+                       throughput(bitmap_length, result->encode_cycles), result->process_cycles,
+                       result->process_cycles / CPU_MHZ, result->repeat_process_cycles,
+                       result->png_length, result->peak_heap, result->arena_peak);
+
+    length = format_encode(buffer, size, length, "compression", compression_names,
+                           result->compression, NUM_COMPRESSION_METHODS);
+    length = format_encode(buffer, size, length, "filters", filter_names, result->filters,
+                           IMAGE_NUM_FILTERS);
+    offset = length < size ? length : size;
+    return length + snprintf(buffer + offset, size - offset, "}");
+}
+
+static esp_err_t run_all(char* buffer, size_t size) {
+    ImageData* image_data = calloc(1, sizeof(ImageData));
+    if (image_data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t length = snprintf(buffer, size, "{\"cpu_mhz\":%d,\"iterations\":%d,\"cases\":[",
+                             CPU_MHZ, ITERATIONS);
+    esp_err_t result = ESP_OK;
+    const size_t num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (size_t i = 0; i < num_cases + num_prints && result == ESP_OK; ++i) {
+        const BenchmarkCase* info = i < num_cases ? &cases[i] : &prints[i - num_cases];
+        BenchmarkResult case_result;
+        result = run_case(info, image_data, &case_result);
+        if (result == ESP_OK) {
+            ESP_LOGI(TAG, "%s: bitmap %lu, encode %lu, process %lu cycles, peak heap %u",
+                     info->name, case_result.bitmap_cycles, case_result.encode_cycles,
+                     case_result.process_cycles, case_result.peak_heap);
+            length = format_case(buffer, size, length, i == 0, info, &case_result);
+        }
+    }
+
+    size_t offset = length < size ? length : size;
+    length += snprintf(buffer + offset, size - offset, "]");
+
+    // PNG chunk CRC.
+    if (result == ESP_OK) {
+        CrcResult crc_result;
+        run_crc(image_data, &crc_result);
+        if (!crc_result.verified) {
+            ESP_LOGE(TAG, "CRC-32 doesn't match reference");
+        }
+        offset = length < size ? length : size;
+        length += snprintf(buffer + offset, size - offset,
+                           ",\"crc\":{\"verified\":%s,\"cycles\":%lu,\"mb_s\":%.2f,"
+                           "\"reference_mb_s\":%.2f}",
+                           crc_result.verified ? "true" : "false", crc_result.cycles,
+                           throughput(PART_LENGTH, crc_result.cycles),
+                           throughput(PART_LENGTH, crc_result.reference_cycles));
+    }
+
+    // Zlib stored-block compression with Adler-32.
+    if (result == ESP_OK) {
+        AdlerResult adler_result;
+        run_adler(image_data, &adler_result);
+        if (!adler_result.verified) {
+            ESP_LOGE(TAG, "Adler-32 doesn't match reference");
+        }
+        offset = length < size ? length : size;
+        length += snprintf(buffer + offset, size - offset,
+                           ",\"zlib_stored\":{\"verified\":%s,\"cycles\":%lu,\"mb_s\":%.2f,"
+                           "\"reference_adler_mb_s\":%.2f}",
+                           adler_result.verified ? "true" : "false", adler_result.cycles,
+                           throughput(PART_LENGTH, adler_result.cycles),
+                           throughput(PART_LENGTH, adler_result.reference_cycles));
+    }
+
+    // Link protocol handling, from sync word to status byte.
+    ProtocolResult protocol_result;
+    if (result == ESP_OK) {
+        result = run_protocol(image_data, &protocol_result);
+    }
+    if (result == ESP_OK) {
+        offset = length < size ? length : size;
+        length += snprintf(buffer + offset, size - offset,
+                           ",\"protocol\":{\"data_packet_cycles\":%lu,\"cycles_per_byte\":%lu,"
+                           "\"status_packet_cycles\":%lu}",
+                           protocol_result.data_packet_cycles,
+                           protocol_result.data_packet_cycles / (PACKET_DATA_SIZE + FRAMING_SIZE),
+                           protocol_result.status_packet_cycles);
+    }
+
+    // Heap fragmentation over many jobs.
+    FragmentationResult fragmentation_result;
+    if (result == ESP_OK) {
+        result = run_fragmentation(image_data, &fragmentation_result);
+    }
+    if (result == ESP_OK) {
+        ESP_LOGI(TAG, "fragmentation: largest free block %u -> %u, min %u",
+                 fragmentation_result.largest_block_before,
+                 fragmentation_result.largest_block_after, fragmentation_result.largest_block_min);
+        offset = length < size ? length : size;
+        length += snprintf(buffer + offset, size - offset,
+                           ",\"fragmentation\":{\"jobs\":%d,\"arena_bytes\":%u,"
+                           "\"free_before_bytes\":%u,\"free_after_bytes\":%u,"
+                           "\"largest_free_block_before_bytes\":%u,"
+                           "\"largest_free_block_after_bytes\":%u,"
+                           "\"largest_free_block_min_bytes\":%u}",
+                           FRAGMENTATION_JOBS, fragmentation_result.arena_size,
+                           fragmentation_result.free_before, fragmentation_result.free_after,
+                           fragmentation_result.largest_block_before,
+                           fragmentation_result.largest_block_after,
+                           fragmentation_result.largest_block_min);
+    }
+
+    // Heap watermarks since boot.
+    offset = length < size ? length : size;
+    snprintf(buffer + offset, size - offset, ",\"heap_free_bytes\":%u,\"heap_min_free_bytes\":%u}",
+             heap_caps_get_free_size(MALLOC_CAP_8BIT),
+             heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+
+    free(image_data);
+    return result;
+}
+
+static void benchmark_task(void* arg) {
+    BenchmarkRun* run = arg;
+    run->result = run_all(run->buffer, run->size);
+
+    const UBaseType_t stack_left = uxTaskGetStackHighWaterMark(NULL);
+    ESP_LOGD(TAG, "Benchmark task stack high-water mark: %u bytes", stack_left);
+    if (stack_left < TASK_STACK_MARGIN) {
+        ESP_LOGW(TAG, "Benchmark task is close to stack overflow: %u bytes left", stack_left);
+    }
+    xTaskNotifyGive(run->caller);
+    vTaskDelete(NULL);
+}
+
+esp_err_t benchmark_add_print(const char* name, const ImageData* parts, int num_parts) {
+    if (num_parts <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (num_prints >= MAX_PRINTS) {
+        return ESP_ERR_NO_MEM;
+    }
+    prints[num_prints].name = name;
+    prints[num_prints].pattern = PATTERN_BLANK;
+    prints[num_prints].num_parts = num_parts;
+    prints[num_prints].parts = parts;
+    ++num_prints;
+    return ESP_OK;
+}
+
+esp_err_t benchmark_run(char* buffer, size_t size) {
+    if (__atomic_test_and_set(&running, __ATOMIC_SEQ_CST)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Printer is held off the link for the whole run, so no print starts meanwhile. Simulated
+    // packets would mix with received data, and a job being encoded would skew measurements.
+    esp_err_t result = printer_simulation_begin();
+    if (result == ESP_OK && (image_num_parts() > 0 || image_num_pending_jobs() > 0)) {
+        result = ESP_ERR_INVALID_STATE;
+    }
+
+    // Cycle counter is per core - run on a task pinned to the current core.
+    BenchmarkRun run = {
+        .buffer = buffer, .size = size, .result = ESP_OK, .caller = xTaskGetCurrentTaskHandle()};
+    if (result == ESP_OK) {
+        result = ESP_ERR_NO_MEM;
+        if (xTaskCreatePinnedToCore(benchmark_task, "benchmark_task", TASK_STACK_SIZE, &run,
+                                    uxTaskPriorityGet(NULL), NULL, xPortGetCoreID()) == pdPASS) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            result = run.result;
+        }
+    }
+
+    const esp_err_t end_result = printer_simulation_end();
+    __atomic_clear(&running, __ATOMIC_SEQ_CST);
+    return result != ESP_OK ? result : end_result;
+}
+
+#endif
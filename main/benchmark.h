@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "image_builder.h"
+
+/// @brief          Run image pipeline and link protocol benchmarks and write results as JSON.
+///                 Measures palette lookup table, bitmap creation, PNG encoding and whole
+///                 image processing, first and repeated, over a corpus of synthetic prints and
+///                 prints added with 'benchmark_add_print', heap fragmentation over many print
+///                 jobs, PNG chunk CRC, zlib stored-block compression with Adler-32 and
+///                 handling of simulated link packets.
+///                 Durations are measured in CPU cycles.
+///                 Blocks for a few seconds. Printer is held off the link meanwhile, current
+///                 image and received data are left untouched.
+/// @param buffer   Output buffer. Output is always null-terminated.
+/// @param size     Size of output buffer.
+/// @return         Error code. ESP_ERR_INVALID_STATE if benchmark is already running
+///                 or printer holds unprocessed image data.
+esp_err_t benchmark_run(char* buffer, size_t size);
+
+/// @brief              Add captured print to benchmark corpus.
+/// @param name         Name of corpus entry. Must stay valid, it's not copied.
+/// @param parts        Image parts of the print, as printed. Must stay valid, they're not copied.
+/// @param num_parts    Number of image parts.
+/// @return             Error code. ESP_ERR_NO_MEM if corpus is full.
+esp_err_t benchmark_add_print(const char* name, const ImageData* parts, int num_parts);
@@ -0,0 +1,109 @@
+#include "capture.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PRINTER_CAPTURE
+
+#define CAPTURE_SIZE CONFIG_PRINTER_CAPTURE_SIZE
+
+static CaptureRecord records[CAPTURE_SIZE];
+// Total number of records, including overwritten ones.
+static uint32_t total_count = 0;
+// Recording is paused while non-zero. Counts exports in progress.
+static volatile int pause_count = 0;
+
+void IRAM_ATTR capture_record(uint8_t rx, uint8_t tx, uint8_t flags) {
+    if (pause_count != 0) {
+        return;
+    }
+
+    CaptureRecord* record = &records[total_count % CAPTURE_SIZE];
+    record->timestamp_us = esp_timer_get_time();
+    record->rx = rx;
+    record->tx = tx;
+    record->flags = flags;
+    record->reserved = 0;
+    ++total_count;
+}
+
+static esp_err_t export_binary(CaptureWriter writer, void* ctx, uint32_t first, uint32_t count) {
+    CaptureHeader header = {.magic = {'G', 'B', 'L', 'C'},
+                            .version = 1,
+                            .record_size = sizeof(CaptureRecord),
+                            .count = count,
+                            .dropped = first};
+    esp_err_t result = writer(&header, sizeof(header), ctx);
+    if (result != ESP_OK || count == 0) {
+        return result;
+    }
+
+    // Records are written directly from the ring, in up to two contiguous slices.
+    const uint32_t start = first % CAPTURE_SIZE;
+    const uint32_t first_slice = count < CAPTURE_SIZE - start ? count : CAPTURE_SIZE - start;
+    result = writer(&records[start], first_slice * sizeof(CaptureRecord), ctx);
+    if (result != ESP_OK || first_slice == count) {
+        return result;
+    }
+    return writer(&records[0], (count - first_slice) * sizeof(CaptureRecord), ctx);
+}
+
+static esp_err_t export_text(CaptureWriter writer, void* ctx, uint32_t first, uint32_t count) {
+    char text[1024];
+    size_t length = snprintf(text, sizeof(text), "# %lu records, %lu dropped\n", count, first);
+
+    for (uint32_t i = first; i < first + count; ++i) {
+        const CaptureRecord* record = &records[i % CAPTURE_SIZE];
+        if (record->flags & CAPTURE_FLAG_SYNC) {
+            length += snprintf(text + length, sizeof(text) - length, "%10lu sync\n",
+                               record->timestamp_us);
+        } else {
+            length += snprintf(text + length, sizeof(text) - length, "%10lu rx %02x tx %02x\n",
+                               record->timestamp_us, record->rx, record->tx);
+        }
+
+        // Flush once there's no room for another line.
+        const size_t kMaxLineLength = 32;
+        if (sizeof(text) - length < kMaxLineLength) {
+            esp_err_t result = writer(text, length, ctx);
+            if (result != ESP_OK) {
+                return result;
+            }
+            length = 0;
+        }
+    }
+
+    return length > 0 ? writer(text, length, ctx) : ESP_OK;
+}
+
+/// @brief Pause recording and let ISR in progress finish.
+static void pause_recording(void) {
+    __atomic_add_fetch(&pause_count, 1, __ATOMIC_SEQ_CST);
+    vTaskDelay(1);
+}
+
+static void resume_recording(void) { __atomic_sub_fetch(&pause_count, 1, __ATOMIC_SEQ_CST); }
+
+esp_err_t capture_export(CaptureWriter writer, void* ctx, bool text) {
+    pause_recording();
+
+    const uint32_t count = total_count < CAPTURE_SIZE ? total_count : CAPTURE_SIZE;
+    const uint32_t first = total_count - count;
+    esp_err_t result = text ? export_text(writer, ctx, first, count)
+                            : export_binary(writer, ctx, first, count);
+
+    resume_recording();
+    return result;
+}
+
+void capture_clear(void) {
+    pause_recording();
+    total_count = 0;
+    resume_recording();
+}
+
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/// @brief Capture record flags.
+enum CaptureFlag {
+    /// @brief Sync word (0x88, 0x33) received, packet starts with next record.
+    CAPTURE_FLAG_SYNC = 1 << 0,
+};
+
+/// @brief Single captured link byte.
+///        Binary trace consists of 'CaptureHeader' followed by 'count' records.
+///        All fields are little-endian.
+typedef struct __attribute__((packed)) {
+    // Time of the byte boundary in microseconds since boot, truncated to 32 bits.
+    uint32_t timestamp_us;
+    // Byte received from GB.
+    uint8_t rx;
+    // Byte sent to GB in the same byte slot.
+    uint8_t tx;
+    // 'CaptureFlag' bits.
+    uint8_t flags;
+    uint8_t reserved;
+} CaptureRecord;
+
+/// @brief Binary trace header.
+typedef struct __attribute__((packed)) {
+    // "GBLC".
+    char magic[4];
+    // Format version, currently 1.
+    uint16_t version;
+    // Size of a single record in bytes.
+    uint16_t record_size;
+    // Number of records following the header.
+    uint32_t count;
+    // Number of records overwritten before export.
+    uint32_t dropped;
+} CaptureHeader;
+
+/// @brief          Callback used to export capture.
+/// @param data     Data to be written.
+/// @param length   Length of data.
+/// @param ctx      User context.
+/// @return         Error code. Export is aborted on error.
+typedef esp_err_t (*CaptureWriter)(const void* data, size_t length, void* ctx);
+
+/// @brief          Record single byte. Oldest record is overwritten once buffer is full.
+///                 Must be called from clock ISR only.
+/// @param rx       Received byte.
+/// @param tx       Sent byte.
+/// @param flags    'CaptureFlag' bits.
+void capture_record(uint8_t rx, uint8_t tx, uint8_t flags);
+
+/// @brief          Export captured records. Recording is paused during export.
+/// @param writer   Output callback.
+/// @param ctx      User context passed to 'writer'.
+/// @param text     Export as text hex log instead of binary trace.
+/// @return         Error code.
+esp_err_t capture_export(CaptureWriter writer, void* ctx, bool text);
+
+/// @brief Remove all captured records.
+void capture_clear(void);
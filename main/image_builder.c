@@ -1,53 +1,459 @@
 #include "image_builder.h"
 #include <string.h>
 #include "common.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "lodepng.h"
+#include "metrics.h"
+#include "pipeline_heap.h"
+#include "png_deflate.h"
+#include "trace.h"
+#include "xxhash32.h"
 
 static const char* TAG = "IMAGE";
 
+ESP_EVENT_DEFINE_BASE(IMAGE_EVENT);
+
 #define PALETTE_SIZE 4
+// Tile size in bytes - 8x8 pixels, 2 bits per pixel.
+#define TILE_SIZE 16
+// Initial number of tile hash table slots.
+#define TILE_SLOTS_INITIAL 64
+// Initial capacity of tile map and tile dictionary, in tiles. Chunk of received data has 80.
+#define TILES_INITIAL 128
+
+#if CONFIG_PRINTER_PNG_FILTER_NONE
+#define CONFIGURED_FILTER IMAGE_FILTER_NONE
+#elif CONFIG_PRINTER_PNG_FILTER_UP
+#define CONFIGURED_FILTER IMAGE_FILTER_UP
+#elif CONFIG_PRINTER_PNG_FILTER_REPEATED_ROWS
+#define CONFIGURED_FILTER IMAGE_FILTER_REPEATED_ROWS
+#elif CONFIG_PRINTER_PNG_FILTER_CONTENT
+#define CONFIGURED_FILTER IMAGE_FILTER_CONTENT
+#else
+#define CONFIGURED_FILTER IMAGE_FILTER_AUTO
+#endif
+
+_Static_assert((CONFIG_PRINTER_PNG_LZ77_WINDOW & (CONFIG_PRINTER_PNG_LZ77_WINDOW - 1)) == 0,
+               "LZ77 window size must be a power of two");
 
 // Fixed image width in pixels.
 static const uint32_t px_width = 160;
 // Fixed image width in tiles.
 static const uint32_t tile_width = px_width / 8;
 
-static int num_image_parts = 0;
-static ImageData* image_parts = NULL;
+/// @brief Stored image part. Tile data is kept in tile dictionary.
+typedef struct {
+    uint8_t palette;
+    uint8_t exposure;
+    // Length of image part data in bytes.
+    uint32_t length;
+    // Index of first tile of the part in tile map. Shared by identical parts.
+    uint32_t first_tile;
+    // XXH32 of image part data.
+    uint32_t hash;
+} ImagePart;
+
+/// @brief Print job - stored image parts with their tiles.
+struct ImageJob {
+    ImagePart* parts;
+    int num_parts;
+    // Dictionary index of each stored tile, in order of image parts.
+    uint16_t* tile_map;
+    size_t num_tiles;
+    size_t tile_map_capacity;
+    // Unique tiles of the job.
+    uint8_t (*tile_dict)[TILE_SIZE];
+    size_t num_unique_tiles;
+    size_t tile_dict_capacity;
+    // Open addressing hash table over tile dictionary. Slot holds dictionary index + 1, 0 if
+    // empty. Kept at most three quarters full. Needed while parts are received only.
+    uint16_t* tile_slots;
+    size_t num_tile_slots;
+    // Trace job recording the job, see 'trace_job_take'.
+    uint32_t trace_id;
+};
+
+// Print job being received. Owned by the task adding image parts.
+static ImageJob received_job = {0};
+// Number of print jobs taken and not processed yet.
+static atomic_int pending_jobs = 0;
+
+/// @brief Image part being received. Its tiles are stored as data arrives.
+typedef struct {
+    // Some data arrived, or part was finished empty.
+    bool started;
+    // Part was refused, remaining data is dropped.
+    bool refused;
+    uint32_t length;
+    // Index of first tile of the part in tile map.
+    uint32_t first_tile;
+    XXHash32State hash;
+    // Trailing data not forming a whole tile yet.
+    uint8_t tile[TILE_SIZE];
+    uint32_t tile_length;
+} PendingPart;
+
+static PendingPart pending_part = {0};
+
+// Currently published PNG image.
+static ImageSnapshot* _Atomic published_snapshot = NULL;
+// Published images of last print jobs, current one included. Each slot holds a reference.
+// Newest image is in slot 'history_head'.
+static ImageSnapshot* _Atomic image_history[CONFIG_PRINTER_IMAGE_HISTORY];
+static atomic_uint history_head = 0;
+// Number of readers between loading published snapshot and taking a reference.
+static atomic_uint active_readers = 0;
 
-static uint8_t* png_buffer = NULL;
-static size_t png_length = 0;
+/// @brief Free stored image parts and tiles of the job. Job itself is left empty.
+static void clear_job(ImageJob* job) {
+    pipeline_free(job->parts);
+    pipeline_free(job->tile_map);
+    pipeline_free(job->tile_dict);
+    pipeline_free(job->tile_slots);
+    memset(job, 0, sizeof(ImageJob));
+}
 
 void image_clear(void) {
-    free(image_parts);
-    image_parts = NULL;
-    num_image_parts = 0;
+    clear_job(&received_job);
+    memset(&pending_part, 0, sizeof(PendingPart));
 }
 
-esp_err_t image_add_data(ImageData* image_data) {
-    int current_num = num_image_parts;
-    // Increase number of entries.
-    ++num_image_parts;
+/// @return Length of 8bpp bitmap created from first 'num_parts' image parts of the job.
+static size_t parts_bitmap_length(const ImageJob* job, int num_parts) {
+    size_t bitmap_length = 0;
+    for (int i = 0; i < num_parts; ++i) {
+        bitmap_length += job->parts[i].length * 4;
+    }
+    return bitmap_length;
+}
+
+/// @return Heap used by stored image parts of the job, including tile dictionary.
+static size_t stored_parts_length(const ImageJob* job) {
+    return job->num_parts * sizeof(ImagePart) + job->tile_map_capacity * sizeof(uint16_t) +
+           job->tile_dict_capacity * TILE_SIZE + job->num_tile_slots * sizeof(uint16_t);
+}
+
+/// @brief  Estimate peak heap usage of a job - image parts, bitmap and encoder buffers.
+///         Encoder buffers stay below bitmap size, as image is encoded with 2 bits per pixel.
+static size_t estimate_job_heap(size_t parts_length, size_t bitmap_length) {
+    return parts_length + bitmap_length * 2;
+}
+
+static uint32_t tile_hash(const uint8_t* tile) {
+    uint32_t words[TILE_SIZE / sizeof(uint32_t)];
+    memcpy(words, tile, TILE_SIZE);
+    uint32_t hash = 0;
+    for (size_t i = 0; i < TILE_SIZE / sizeof(uint32_t); ++i) {
+        hash = (hash ^ words[i]) * 0x9E3779B1;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/// @brief  Double the number of hash table slots.
+/// @return Error code.
+static esp_err_t grow_tile_slots(ImageJob* job) {
+    const size_t slots = job->num_tile_slots > 0 ? job->num_tile_slots * 2 : TILE_SLOTS_INITIAL;
+    uint16_t* new_slots = pipeline_calloc(PIPELINE_STAGE_PARTS, slots * sizeof(uint16_t));
+    if (new_slots == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Rehash dictionary.
+    for (size_t index = 0; index < job->num_unique_tiles; ++index) {
+        size_t slot = tile_hash(job->tile_dict[index]) & (slots - 1);
+        while (new_slots[slot] != 0) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        new_slots[slot] = index + 1;
+    }
+    pipeline_free(job->tile_slots);
+    job->tile_slots = new_slots;
+    job->num_tile_slots = slots;
+    return ESP_OK;
+}
+
+/// @brief          Find tile in dictionary of the job, add it if not found.
+///                 Dictionary must have room for another tile.
+/// @param job      Print job.
+/// @param tile     Tile data.
+/// @param index    Output - dictionary index of the tile.
+/// @return         Error code.
+static esp_err_t intern_tile(ImageJob* job, const uint8_t* tile, uint16_t* index) {
+    if ((job->num_unique_tiles + 1) * 4 > job->num_tile_slots * 3) {
+        ESP_ERROR_RETURN(grow_tile_slots(job));
+    }
+
+    const size_t mask = job->num_tile_slots - 1;
+    size_t slot = tile_hash(tile) & mask;
+    while (job->tile_slots[slot] != 0) {
+        *index = job->tile_slots[slot] - 1;
+        if (memcmp(job->tile_dict[*index], tile, TILE_SIZE) == 0) {
+            metrics_inc(METRICS_DUPLICATE_TILES);
+            return ESP_OK;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    memcpy(job->tile_dict[job->num_unique_tiles], tile, TILE_SIZE);
+    job->tile_slots[slot] = job->num_unique_tiles + 1;
+    *index = job->num_unique_tiles++;
+    return ESP_OK;
+}
+
+/// @brief          Make room for items, doubling capacity until they fit.
+/// @param items    Items allocated with pipeline allocator, NULL if none.
+/// @param capacity Capacity in items. Updated once grown.
+/// @param count    Number of items to fit.
+/// @param size     Item size in bytes.
+/// @return         Items, they might have moved. NULL if out of memory - items are left untouched.
+static void* reserve_items(void* items, size_t* capacity, size_t count, size_t size) {
+    if (count <= *capacity) {
+        return items;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : TILES_INITIAL;
+    while (new_capacity < count) {
+        new_capacity *= 2;
+    }
+    void* new_items = pipeline_realloc(PIPELINE_STAGE_PARTS, items, new_capacity * size);
+    if (new_items != NULL) {
+        *capacity = new_capacity;
+    }
+    return new_items;
+}
+
+/// @brief          Append whole tiles to tile map, as indices into tile dictionary.
+/// @param job      Print job.
+/// @param data     Tile data.
+/// @param count    Number of tiles.
+/// @return         Error code.
+static esp_err_t store_tiles(ImageJob* job, const uint8_t* data, size_t count) {
+    if (count == 0) {
+        return ESP_OK;
+    }
+
+    uint16_t* map = reserve_items(job->tile_map, &job->tile_map_capacity, job->num_tiles + count,
+                                  sizeof(uint16_t));
+    if (map == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->tile_map = map;
+
+    // Make room for all tiles being unique. Slot value 0 marks empty slot.
+    if (job->num_unique_tiles + count >= UINT16_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t(*dict)[TILE_SIZE] = reserve_items(job->tile_dict, &job->tile_dict_capacity,
+                                              job->num_unique_tiles + count, TILE_SIZE);
+    if (dict == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->tile_dict = dict;
+
+    // Tiles added before a failure stay in dictionary, they just aren't referenced.
+    esp_err_t result = ESP_OK;
+    for (size_t i = 0; i < count && result == ESP_OK; ++i) {
+        result = intern_tile(job, data + i * TILE_SIZE, &job->tile_map[job->num_tiles + i]);
+    }
+    if (result == ESP_OK) {
+        job->num_tiles += count;
+    }
+    return result;
+}
+
+/// @brief Release unused capacity of tile map and tile dictionary, once all parts are stored.
+static void trim_tiles(ImageJob* job) {
+    if (job->num_tiles > 0 && job->num_tiles < job->tile_map_capacity) {
+        uint16_t* map = pipeline_realloc(PIPELINE_STAGE_PARTS, job->tile_map,
+                                         job->num_tiles * sizeof(uint16_t));
+        if (map != NULL) {
+            job->tile_map = map;
+            job->tile_map_capacity = job->num_tiles;
+        }
+    }
+    if (job->num_unique_tiles > 0 && job->num_unique_tiles < job->tile_dict_capacity) {
+        uint8_t(*dict)[TILE_SIZE] = pipeline_realloc(PIPELINE_STAGE_PARTS, job->tile_dict,
+                                                     job->num_unique_tiles * TILE_SIZE);
+        if (dict != NULL) {
+            job->tile_dict = dict;
+            job->tile_dict_capacity = job->num_unique_tiles;
+        }
+    }
+}
+
+/// @brief  Start pending part, if not started yet. First part starts new job.
+static void start_part(ImageJob* job, PendingPart* pending) {
+    if (pending->started) {
+        return;
+    }
+    if (job->num_parts == 0) {
+        pipeline_heap_job_begin();
+    }
+    pending->started = true;
+    pending->first_tile = job->num_tiles;
+    xxhash32_init(&pending->hash, 0);
+}
+
+/// @brief  Drop pending part. Its tiles stay in dictionary, they just aren't referenced.
+static void reset_part(ImageJob* job, PendingPart* pending) {
+    if (pending->started) {
+        job->num_tiles = pending->first_tile;
+    }
+    memset(pending, 0, sizeof(PendingPart));
+}
+
+/// @brief  Refuse pending part - remaining data is dropped and finishing the part fails.
+static void refuse_part(ImageJob* job, PendingPart* pending) {
+    job->num_tiles = pending->first_tile;
+    pending->refused = true;
+}
+
+/// @brief  Append data to pending part of the job, see 'image_append_data'.
+static esp_err_t append_data(ImageJob* job, PendingPart* pending, const uint8_t* data,
+                             size_t length) {
+    start_part(job, pending);
+    if (pending->refused) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Refuse part which would make the job exceed heap budget, assuming none of its tiles
+    // is already stored. Image is still created from previous parts.
+    const size_t new_tiles = length / TILE_SIZE + 1;
+    const size_t parts_length = stored_parts_length(job) + sizeof(ImagePart) +
+                                new_tiles * (sizeof(uint16_t) * 3 + TILE_SIZE);
+    const size_t bitmap_length =
+        parts_bitmap_length(job, job->num_parts) + (pending->length + length) * 4;
+    if (!pipeline_heap_admit(estimate_job_heap(parts_length, bitmap_length))) {
+        ESP_LOGW(TAG, "Image part refused, heap budget exceeded");
+        refuse_part(job, pending);
+        return ESP_ERR_NO_MEM;
+    }
+    xxhash32_update(&pending->hash, data, length);
+    pending->length += length;
+
+    // Complete tile left over from previous data.
+    if (pending->tile_length > 0) {
+        const size_t fill = TILE_SIZE - pending->tile_length < length
+                                ? TILE_SIZE - pending->tile_length
+                                : length;
+        memcpy(pending->tile + pending->tile_length, data, fill);
+        pending->tile_length += fill;
+        data += fill;
+        length -= fill;
+        if (pending->tile_length < TILE_SIZE) {
+            return ESP_OK;
+        }
+        pending->tile_length = 0;
+        if (store_tiles(job, pending->tile, 1) != ESP_OK) {
+            refuse_part(job, pending);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // Copy data, repeated tiles are stored once.
+    const size_t whole_tiles = length / TILE_SIZE;
+    if (store_tiles(job, data, whole_tiles) != ESP_OK) {
+        refuse_part(job, pending);
+        return ESP_ERR_NO_MEM;
+    }
+    pending->tile_length = length - whole_tiles * TILE_SIZE;
+    memcpy(pending->tile, data + whole_tiles * TILE_SIZE, pending->tile_length);
+    return ESP_OK;
+}
+
+esp_err_t image_append_data(const uint8_t* data, size_t length) {
+    return append_data(&received_job, &pending_part, data, length);
+}
+
+/// @brief  Finish pending part of the job, see 'image_finish_part'.
+static esp_err_t finish_part(ImageJob* job, PendingPart* pending, uint8_t palette,
+                             uint8_t exposure) {
+    start_part(job, pending);
+    if (pending->refused) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Trailing partial tile is padded with zeros.
+    if (pending->tile_length > 0) {
+        memset(pending->tile + pending->tile_length, 0,
+               TILE_SIZE - pending->tile_length);
+        if (store_tiles(job, pending->tile, 1) != ESP_OK) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
     // Increase size of memory.
-    image_parts = realloc(image_parts, sizeof(ImageData) * num_image_parts);
-    // Copy data.
-    memcpy(image_parts + current_num, image_data, sizeof(ImageData));
+    ImagePart* parts = pipeline_realloc(PIPELINE_STAGE_PARTS, job->parts,
+                                        sizeof(ImagePart) * (job->num_parts + 1));
+    if (parts == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->parts = parts;
 
+    ImagePart* part = &job->parts[job->num_parts];
+    part->palette = palette;
+    part->exposure = exposure;
+    part->length = pending->length;
+    part->first_tile = pending->first_tile;
+    part->hash = xxhash32_digest(&pending->hash);
+    ++job->num_parts;
+
+    // Identical part, e.g., a repeated print, refers to tiles of the stored one.
+    // Identical data is stored as identical tile indices.
+    const size_t part_tiles = job->num_tiles - part->first_tile;
+    for (int i = 0; i < job->num_parts - 1; ++i) {
+        const ImagePart* stored = &job->parts[i];
+        if (stored->hash == part->hash && stored->length == part->length &&
+            memcmp(job->tile_map + stored->first_tile, job->tile_map + part->first_tile,
+                   part_tiles * sizeof(uint16_t)) == 0) {
+            job->num_tiles = part->first_tile;
+            part->first_tile = stored->first_tile;
+            metrics_inc(METRICS_DUPLICATE_PARTS);
+            metrics_add(METRICS_DEDUP_SAVED_BYTES, part->length);
+            break;
+        }
+    }
+
+    // Part is kept with its tiles.
+    memset(pending, 0, sizeof(PendingPart));
     return ESP_OK;
 }
 
-int image_num_parts(void) { return num_image_parts; }
+esp_err_t image_finish_part(uint8_t palette, uint8_t exposure) {
+    trace_record(TRACE_ADD_DATA, TRACE_BEGIN);
+    esp_err_t result = finish_part(&received_job, &pending_part, palette, exposure);
+    trace_record(TRACE_ADD_DATA, TRACE_END);
+    metrics_inc(result == ESP_OK ? METRICS_IMAGE_PARTS : METRICS_IMAGE_PARTS_REJECTED);
+    if (result != ESP_OK) {
+        reset_part(&received_job, &pending_part);
+    }
+
+    return result;
+}
+
+void image_discard_part(void) { reset_part(&received_job, &pending_part); }
+
+esp_err_t image_add_data(ImageData* image_data) {
+    // Refused data is reported once part is finished.
+    image_append_data(image_data->data, image_data->length);
+    return image_finish_part(image_data->palette, image_data->exposure);
+}
+
+int image_num_parts(void) { return received_job.num_parts; }
 
 static uint32_t coord_1d(uint32_t x, uint32_t y, uint32_t width) { return y * width + x; }
 
-static void draw_tile(uint8_t* buffer, ImageData* image_part, const uint8_t palette_lut[],
-                      uint32_t x_tile, uint32_t y_tile, uint32_t y_tile_offset) {
+static void draw_tile(uint8_t* buffer, const uint8_t* tile, const uint8_t palette_lut[],
+                      uint32_t x_tile, uint32_t y_tile) {
     const uint32_t y_px_start = y_tile * 8;
     const uint32_t x_px_start = x_tile * 8;
-    const uint32_t y_tile_compensated = y_tile - y_tile_offset;
 
-    uint8_t* buf_ptr = image_part->data + (coord_1d(x_tile, y_tile_compensated, tile_width) * 16);
+    const uint8_t* buf_ptr = tile;
 
     for (uint32_t y_px = y_px_start; y_px < y_px_start + 8; ++y_px) {
         uint32_t x_px = x_px_start;
@@ -66,11 +472,17 @@ static void draw_tile(uint8_t* buffer, ImageData* image_part, const uint8_t pale
     }
 }
 
-static esp_err_t create_palette_lut(const ImageData* image_data, uint8_t palette_lut[]) {
+/// @brief Copy already drawn tile within bitmap.
+static void copy_tile(uint8_t* buffer, uint32_t from_coord, uint32_t to_coord) {
+    for (uint32_t y_px = 0; y_px < 8; ++y_px) {
+        memcpy(buffer + to_coord + y_px * px_width, buffer + from_coord + y_px * px_width, 8);
+    }
+}
+
+static esp_err_t create_palette_lut(uint8_t gb_palette, uint8_t exposure, uint8_t palette_lut[]) {
     // Build 8-bit grayscale palette based on 2-bit GB palette.
-    const uint8_t gb_palette = image_data->palette;
     // Exposure is 7-bit value - ignore MSB.
-    const uint8_t exposure = image_data->exposure & 0x7F;
+    exposure &= 0x7F;
     for (int i = 0; i < PALETTE_SIZE; ++i) {
         // Apply values based on GB palette.
         uint8_t gb_palette_value = (gb_palette & (0b11 << i * 2)) >> i * 2;
@@ -109,18 +521,19 @@ static esp_err_t create_palette_lut(const ImageData* image_data, uint8_t palette
     return ESP_OK;
 }
 
-static esp_err_t create_bitmap(uint8_t** buffer, uint32_t* image_height_px) {
+static esp_err_t create_bitmap(const ImageJob* job, uint8_t** buffer,
+                               uint32_t* image_height_px) {
     // TODO: remove/change arbitrary limitation to 32 image parts.
-    if (num_image_parts > 32) {
-        ESP_LOGE(TAG, "Unsupported number of image parts: %d", num_image_parts);
+    if (job->num_parts > 32) {
+        ESP_LOGE(TAG, "Unsupported number of image parts: %d", job->num_parts);
         return ESP_ERR_INVALID_ARG;
     }
 
     // Calculate required sizes.
     size_t bitmap_length = 0;
-    size_t num_tiles[32] = {0};
-    for (size_t i = 0; i < num_image_parts; ++i) {
-        const size_t length = image_parts[i].length;
+    size_t num_part_tiles[32] = {0};
+    for (int i = 0; i < job->num_parts; ++i) {
+        const size_t length = job->parts[i].length;
 
         // Increase bitmap length, assuming 8bpp depth.
         bitmap_length += length * 4;
@@ -135,67 +548,649 @@ static esp_err_t create_bitmap(uint8_t** buffer, uint32_t* image_height_px) {
             return ESP_ERR_INVALID_SIZE;
         }
         *image_height_px += local_height_px;
-        num_tiles[i] = local_height_px / 8;
+        num_part_tiles[i] = local_height_px / 8;
     }
 
     // Allocate bitmap buffer.
-    *buffer = calloc(bitmap_length, sizeof(uint8_t));
+    *buffer = pipeline_calloc(PIPELINE_STAGE_BITMAP, bitmap_length);
+    if (*buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Nothing to draw, e.g., job of empty parts only.
+    if (job->num_unique_tiles == 0) {
+        return ESP_OK;
+    }
+
+    // Bitmap coordinate of each unique tile once drawn, with part it was drawn for.
+    // Tiles repeating within a part are copied instead of decoded again.
+    uint32_t* drawn_coord = pipeline_malloc(PIPELINE_STAGE_BITMAP,
+                                            job->num_unique_tiles * (sizeof(uint32_t) + 1));
+    if (drawn_coord == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t* drawn_part = (uint8_t*)(drawn_coord + job->num_unique_tiles);
+    memset(drawn_part, 0, job->num_unique_tiles);
 
     // Draw each tile.
     uint32_t curr_tile_height = 0;
-    for (int i = 0; i < num_image_parts; ++i) {
-        const uint32_t tile_height = num_tiles[i];
-        ImageData* image_data = &image_parts[i];
+    for (int i = 0; i < job->num_parts; ++i) {
+        const uint32_t tile_height = num_part_tiles[i];
+        const ImagePart* part = &job->parts[i];
         uint8_t palette_lut[PALETTE_SIZE];
-        ESP_ERROR_RETURN(create_palette_lut(image_data, palette_lut));
+        esp_err_t lut_result = create_palette_lut(part->palette, part->exposure, palette_lut);
+        if (lut_result != ESP_OK) {
+            pipeline_free(drawn_coord);
+            return lut_result;
+        }
+        const uint16_t* part_map = job->tile_map + part->first_tile;
         for (size_t y = curr_tile_height; y < curr_tile_height + tile_height; ++y) {
             for (size_t x = 0; x < tile_width; ++x) {
-                draw_tile(*buffer, image_data, palette_lut, x, y, curr_tile_height);
+                const uint16_t index = part_map[coord_1d(x, y - curr_tile_height, tile_width)];
+                const uint32_t coord = coord_1d(x * 8, y * 8, px_width);
+                if (drawn_part[index] == i + 1) {
+                    copy_tile(*buffer, drawn_coord[index], coord);
+                } else {
+                    draw_tile(*buffer, job->tile_dict[index], palette_lut, x, y);
+                    drawn_coord[index] = coord;
+                    drawn_part[index] = i + 1;
+                }
             }
         }
         curr_tile_height += tile_height;
     }
+    pipeline_free(drawn_coord);
 
     return ESP_OK;
 }
 
-esp_err_t image_process(void) {
-    // Create a bitmap.
-    uint8_t* bmp_buffer = NULL;
-    uint32_t px_height = 0;
-    esp_err_t bmp_result = create_bitmap(&bmp_buffer, &px_height);
-    if (bmp_result != ESP_OK) {
-        free(bmp_buffer);
-        return bmp_result;
+/// @brief          Set compression settings of PNG encoder from configuration.
+/// @param settings Compression settings, initialized with defaults.
+static void configure_compression(LodePNGCompressSettings* settings) {
+    // Compact matcher settings are used by benchmark even if compression is disabled.
+    settings->windowsize = CONFIG_PRINTER_PNG_LZ77_WINDOW;
+    settings->hashbits = CONFIG_PRINTER_PNG_LZ77_HASH_BITS;
+    settings->maxchainlength = CONFIG_PRINTER_PNG_LZ77_CHAIN;
+#if CONFIG_PRINTER_PNG_COMPRESSION_COMPACT
+    settings->btype = 2;
+#elif CONFIG_PRINTER_PNG_COMPRESSION_FIXED
+    settings->btype = 1;
+    settings->custom_deflate = png_deflate_fixed;
+#else
+    settings->btype = 0;
+#endif
+}
+
+// Row filter of each content class, see 'ImageContent'.
+static const enum ImageFilter content_filters[IMAGE_NUM_CONTENT_CLASSES] = {
+    [IMAGE_CONTENT_BLANK] = IMAGE_FILTER_NONE,
+    [IMAGE_CONTENT_PHOTO] = IMAGE_FILTER_NONE,
+    [IMAGE_CONTENT_REPEATED_ROWS] = IMAGE_FILTER_REPEATED_ROWS,
+};
+
+/// @brief              Classify content of print job by rows of its bitmap.
+/// @param bitmap       8bpp bitmap, 'px_width' pixels wide.
+/// @param px_height    Bitmap height in pixels.
+/// @return             Content class.
+static enum ImageContent classify_content(const uint8_t* bitmap, uint32_t px_height) {
+    uint32_t repeated_rows = 0;
+    for (uint32_t y = 1; y < px_height; ++y) {
+        const uint8_t* row = bitmap + y * px_width;
+        repeated_rows += memcmp(row, row - px_width, px_width) == 0;
     }
+    // Every row repeats the first one, which is a single color.
+    if (px_height > 0 && repeated_rows == px_height - 1 &&
+        memcmp(bitmap, bitmap + 1, px_width - 1) == 0) {
+        return IMAGE_CONTENT_BLANK;
+    }
+    return repeated_rows * 2 >= px_height ? IMAGE_CONTENT_REPEATED_ROWS : IMAGE_CONTENT_PHOTO;
+}
 
-    // Encode image to memory.
+/// @brief              Set row filters of PNG encoder.
+/// @param encoder      Encoder settings.
+/// @param filter       Filter strategy.
+/// @param bitmap       8bpp bitmap, 'px_width' pixels wide.
+/// @param px_height    Bitmap height in pixels.
+/// @param row_filters  Output - filter of each row, if predefined. Must be freed with
+///                     'pipeline_free'.
+/// @return             Error code.
+static esp_err_t configure_filter(LodePNGEncoderSettings* encoder, enum ImageFilter filter,
+                                  const uint8_t* bitmap, uint32_t px_height,
+                                  uint8_t** row_filters) {
+    // LodePNG forces no filter for palette images, which GB images become, unless told not to.
+    switch (filter) {
+        case IMAGE_FILTER_AUTO: {
+            break;
+        }
+        case IMAGE_FILTER_NONE: {
+            encoder->filter_strategy = LFS_ZERO;
+            break;
+        }
+        case IMAGE_FILTER_UP: {
+            encoder->filter_palette_zero = 0;
+            encoder->filter_strategy = LFS_TWO;
+            break;
+        }
+        case IMAGE_FILTER_REPEATED_ROWS: {
+            // Rows of 8bpp bitmap repeat exactly when rows of encoded image do.
+            *row_filters = pipeline_malloc(PIPELINE_STAGE_ENCODE, px_height);
+            if (*row_filters == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            for (uint32_t y = 0; y < px_height; ++y) {
+                const uint8_t* row = bitmap + y * px_width;
+                const bool repeated = y > 0 && memcmp(row, row - px_width, px_width) == 0;
+                (*row_filters)[y] = repeated ? 2 : 0;
+            }
+            encoder->filter_palette_zero = 0;
+            encoder->filter_strategy = LFS_PREDEFINED;
+            encoder->predefined_filters = *row_filters;
+            break;
+        }
+        case IMAGE_FILTER_CONTENT: {
+            const enum ImageContent content = classify_content(bitmap, px_height);
+            ESP_LOGD(TAG, "Image content class: %d", content);
+            return configure_filter(encoder, content_filters[content], bitmap, px_height,
+                                    row_filters);
+        }
+        default: {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+/// @brief              Encode grayscale bitmap as PNG.
+/// @param bitmap       8bpp bitmap, 'px_width' pixels wide.
+/// @param px_height    Bitmap height in pixels.
+/// @param options      Encoder options. NULL to use configured ones.
+/// @param png_buffer   Output - PNG data. Must be freed with 'pipeline_free'.
+/// @param png_length   Output - PNG data length.
+/// @return             Error code.
+static esp_err_t encode_png(const uint8_t* bitmap, uint32_t px_height,
+                            const ImageEncodeOptions* options, uint8_t** png_buffer,
+                            size_t* png_length) {
     LodePNGState state;
     lodepng_state_init(&state);
     state.info_raw.colortype = LCT_GREY;
     state.info_raw.bitdepth = 8;
     state.info_png.color.colortype = LCT_GREY;
     state.info_png.color.bitdepth = 8;
-    state.encoder.zlibsettings.btype = 0;
+    enum ImageFilter filter = CONFIGURED_FILTER;
+    if (options != NULL) {
+        state.encoder.zlibsettings = options->compression;
+        filter = options->filter;
+    } else {
+        configure_compression(&state.encoder.zlibsettings);
+    }
+    uint8_t* row_filters = NULL;
+    esp_err_t filter_result =
+        configure_filter(&state.encoder, filter, bitmap, px_height, &row_filters);
+    if (filter_result != ESP_OK) {
+        lodepng_state_cleanup(&state);
+        return filter_result;
+    }
+
     unsigned int result =
-        lodepng_encode(&png_buffer, &png_length, bmp_buffer, px_width, px_height, &state);
+        lodepng_encode(png_buffer, png_length, bitmap, px_width, px_height, &state);
     lodepng_state_cleanup(&state);
-    free(bmp_buffer);
+    pipeline_free(row_filters);
     if (result != 0) {
+        pipeline_free(*png_buffer);
+        *png_buffer = NULL;
         ESP_LOGE(TAG, "LodePNG failed with error code: %u", result);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Image ready");
     return ESP_OK;
 }
 
-size_t image_png_length(void) { return png_length; }
+/// @brief Wait until readers taking a reference to a replaced snapshot are done.
+///        Their window is only a few instructions long.
+static void wait_readers(void) {
+    while (atomic_load(&active_readers) > 0) {
+        vTaskDelay(1);
+    }
+}
+
+/// @brief          Publish snapshot as current image, previous one is kept in image history.
+///                 Oldest image of history is released.
+/// @param snapshot Snapshot to publish, holding a reference for each - current image and
+///                 history.
+static void publish_snapshot(ImageSnapshot* snapshot) {
+    const unsigned int head = (atomic_load(&history_head) + 1) % CONFIG_PRINTER_IMAGE_HISTORY;
+    ImageSnapshot* evicted = atomic_exchange(&image_history[head], snapshot);
+    atomic_store(&history_head, head);
+    ImageSnapshot* previous = atomic_exchange(&published_snapshot, snapshot);
+    wait_readers();
+
+    // Identical jobs are only recognized for current image, previous job isn't needed anymore.
+    // Publisher's reference keeps the snapshot alive meanwhile.
+    if (previous != NULL && previous != evicted) {
+        clear_job(previous->job);
+        pipeline_free(previous->job);
+        previous->job = NULL;
+    }
+    image_snapshot_release(previous);
+    image_snapshot_release(evicted);
+}
+
+/// @brief  Drop trailing image parts of the job until processing fits into free heap.
+/// @return Error code. ESP_ERR_NO_MEM if not even a single part fits.
+static esp_err_t admit_job(ImageJob* job) {
+    const int requested_parts = job->num_parts;
+    size_t bitmap_length = parts_bitmap_length(job, job->num_parts);
+    // Bitmap is allocated as a single block, encoder buffers take up to the same size.
+    // Job fitting into arena doesn't need heap.
+    while (job->num_parts > 0 && bitmap_length * 2 > pipeline_arena_available() &&
+           (bitmap_length > heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) ||
+            bitmap_length * 2 > heap_caps_get_free_size(MALLOC_CAP_8BIT))) {
+        --job->num_parts;
+        bitmap_length -= job->parts[job->num_parts].length * 4;
+    }
+
+    if (job->num_parts == 0) {
+        ESP_LOGE(TAG, "Not enough memory to process image");
+        metrics_inc(METRICS_JOBS_REJECTED);
+        return ESP_ERR_NO_MEM;
+    }
+    if (job->num_parts < requested_parts) {
+        ESP_LOGW(TAG, "Not enough memory, dropped %d of %d image parts",
+                 requested_parts - job->num_parts, requested_parts);
+        metrics_inc(METRICS_JOBS_DEGRADED);
+    }
+    return ESP_OK;
+}
+
+/// @return Content hash of the job - XXH32 over parameters and data hashes of all parts.
+static uint32_t job_content_hash(const ImageJob* job) {
+    XXHash32State state;
+    xxhash32_init(&state, 0);
+    for (int i = 0; i < job->num_parts; ++i) {
+        const ImagePart* part = &job->parts[i];
+        const uint8_t fields[] = {part->palette, part->exposure, part->length & 0xFF,
+                                  (part->length >> 8) & 0xFF, (part->length >> 16) & 0xFF,
+                                  part->length >> 24};
+        xxhash32_update(&state, fields, sizeof(fields));
+        xxhash32_update(&state, &part->hash, sizeof(part->hash));
+    }
+    return xxhash32_digest(&state);
+}
+
+/// @return True if both jobs have identical image parts. Tiles are compared byte by byte.
+static bool same_job_content(const ImageJob* job, const ImageJob* other) {
+    if (job->num_parts != other->num_parts) {
+        return false;
+    }
+
+    for (int i = 0; i < job->num_parts; ++i) {
+        const ImagePart* part = &job->parts[i];
+        const ImagePart* other_part = &other->parts[i];
+        if (part->palette != other_part->palette || part->exposure != other_part->exposure ||
+            part->length != other_part->length) {
+            return false;
+        }
+
+        // Each job has its own tile dictionary, tiles are looked up through tile maps.
+        const size_t part_tiles = (part->length + TILE_SIZE - 1) / TILE_SIZE;
+        const uint16_t* tiles = job->tile_map + part->first_tile;
+        const uint16_t* other_tiles = other->tile_map + other_part->first_tile;
+        for (size_t tile = 0; tile < part_tiles; ++tile) {
+            if (memcmp(job->tile_dict[tiles[tile]], other->tile_dict[other_tiles[tile]],
+                       TILE_SIZE) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// @brief  Take a reference to published snapshot, see 'image_snapshot_acquire'.
+/// @return Published snapshot, NULL if there's none. Image builder may update its counters.
+static ImageSnapshot* acquire_published_snapshot(void) {
+    atomic_fetch_add(&active_readers, 1);
+    ImageSnapshot* snapshot = atomic_load(&published_snapshot);
+    if (snapshot != NULL) {
+        atomic_fetch_add(&snapshot->ref_count, 1);
+    }
+    atomic_fetch_sub(&active_readers, 1);
+    return snapshot;
+}
+
+/// @brief              Count another copy of published image, if it was created from the same
+///                     content.
+/// @param job          Print job.
+/// @param content_hash Content hash of the job.
+/// @return             True if published image was reused.
+static bool reuse_published_image(const ImageJob* job, uint32_t content_hash) {
+    ImageSnapshot* snapshot = acquire_published_snapshot();
+    // Hash match is confirmed against the job the image was created from.
+    if (snapshot == NULL || snapshot->content_hash != content_hash ||
+        !same_job_content(job, snapshot->job)) {
+        image_snapshot_release(snapshot);
+        return false;
+    }
+
+    const uint32_t copies = atomic_fetch_add(&snapshot->copies, 1) + 1;
+    const uint32_t hash = snapshot->hash;
+    image_snapshot_release(snapshot);
+
+    trace_job_finish(job->trace_id, hash);
+    metrics_inc(METRICS_DUPLICATE_JOBS);
+    metrics_add(METRICS_DEDUP_SAVED_BYTES, parts_bitmap_length(job, job->num_parts) / 4);
+    ESP_LOGI(TAG, "Image reused, hash: %08lx, copies: %lu", hash, copies);
+    esp_event_post(IMAGE_EVENT, IMAGE_EVENT_READY, NULL, 0, 0);
+    return true;
+}
+
+/// @return Memory accounted to published image from now on. Original memory if it's empty, or
+///         if it can't be moved.
+static void* keep_for_image(void* ptr, size_t size) {
+    void* kept = ptr != NULL && size > 0 ? pipeline_realloc(PIPELINE_STAGE_IMAGE, ptr, size) : NULL;
+    return kept != NULL ? kept : ptr;
+}
+
+/// @brief  Keep processed job with its published image.
+/// @return Kept job, it might have moved.
+static ImageJob* keep_job(ImageJob* job) {
+    job->parts = keep_for_image(job->parts, job->num_parts * sizeof(ImagePart));
+    job->tile_map = keep_for_image(job->tile_map, job->num_tiles * sizeof(uint16_t));
+    job->tile_dict = keep_for_image(job->tile_dict, job->num_unique_tiles * TILE_SIZE);
+    return keep_for_image(job, sizeof(ImageJob));
+}
+
+/// @brief              Create PNG image of the job, in job arena if it's used.
+/// @param job          Print job.
+/// @param png_buffer   Output - PNG data. Must be freed with 'pipeline_free'.
+/// @param png_length   Output - PNG data length.
+/// @return             Error code.
+static esp_err_t render_png(const ImageJob* job, uint8_t** png_buffer, size_t* png_length) {
+    // Create a bitmap.
+    uint8_t* bmp_buffer = NULL;
+    uint32_t px_height = 0;
+    trace_record_job(job->trace_id, TRACE_BITMAP, TRACE_BEGIN);
+    esp_err_t bmp_result = create_bitmap(job, &bmp_buffer, &px_height);
+    trace_record_job(job->trace_id, TRACE_BITMAP, TRACE_END);
+    if (bmp_result != ESP_OK) {
+        pipeline_free(bmp_buffer);
+        return bmp_result;
+    }
+
+    // Encode image to memory.
+    const int64_t encode_start_us = esp_timer_get_time();
+    trace_record_job(job->trace_id, TRACE_ENCODE, TRACE_BEGIN);
+    esp_err_t encode_result = encode_png(bmp_buffer, px_height, NULL, png_buffer, png_length);
+    trace_record_job(job->trace_id, TRACE_ENCODE, TRACE_END);
+    metrics_observe(METRICS_ENCODE_DURATION_US, esp_timer_get_time() - encode_start_us);
+    pipeline_free(bmp_buffer);
+    return encode_result;
+}
+
+/// @brief              Create and publish image of the job.
+/// @param job          Print job. It's kept with published image on success.
+/// @param content_hash Content hash of the job.
+/// @return             Error code.
+static esp_err_t create_image(ImageJob* job, uint32_t content_hash) {
+    uint8_t* png_buffer = NULL;
+    size_t png_length = 0;
+    ESP_ERROR_RETURN(render_png(job, &png_buffer, &png_length));
+
+    // Publish image. Job might move once kept with it.
+    const uint32_t trace_id = job->trace_id;
+    trace_record_job(trace_id, TRACE_PUBLISH, TRACE_BEGIN);
+    ImageSnapshot* snapshot = pipeline_malloc(PIPELINE_STAGE_IMAGE, sizeof(ImageSnapshot));
+    if (snapshot == NULL) {
+        pipeline_free(png_buffer);
+        return ESP_ERR_NO_MEM;
+    }
+    // Encoder output is kept as published image, out of job arena.
+    uint8_t* png_data = pipeline_persist(png_buffer, png_length, PIPELINE_STAGE_IMAGE);
+    if (png_data == NULL) {
+        pipeline_free(png_buffer);
+        pipeline_free(snapshot);
+        return ESP_ERR_NO_MEM;
+    }
+    png_buffer = png_data;
+    // References are held by publisher until snapshot is replaced, and until it leaves history.
+    const uint32_t hash = lodepng_crc32(png_buffer, png_length);
+    atomic_init(&snapshot->ref_count, 2);
+    atomic_init(&snapshot->copies, 1);
+    snapshot->hash = hash;
+    snapshot->content_hash = content_hash;
+    snapshot->job = keep_job(job);
+    snapshot->length = png_length;
+    snapshot->data = png_buffer;
+    publish_snapshot(snapshot);
+    trace_record_job(trace_id, TRACE_PUBLISH, TRACE_END);
+    trace_job_finish(trace_id, hash);
+    metrics_inc(METRICS_IMAGES);
+    metrics_observe(METRICS_PNG_SIZE_BYTES, png_length);
+
+    ESP_LOGI(TAG, "Image ready, hash: %08lx", hash);
+    esp_event_post(IMAGE_EVENT, IMAGE_EVENT_READY, NULL, 0, 0);
+    return ESP_OK;
+}
 
-const uint8_t* image_png_buffer(void) { return png_buffer; }
+ImageJob* image_take_job(void) {
+    // Unfinished part is not part of the job.
+    reset_part(&received_job, &pending_part);
+    if (received_job.num_parts == 0) {
+        return NULL;
+    }
+
+    ImageJob* job = pipeline_malloc(PIPELINE_STAGE_PARTS, sizeof(ImageJob));
+    if (job == NULL) {
+        trace_job_fail(trace_job_take());
+        image_clear();
+        return NULL;
+    }
+    // Tile hash table is only needed to add parts.
+    pipeline_free(received_job.tile_slots);
+    received_job.tile_slots = NULL;
+    received_job.num_tile_slots = 0;
+    trim_tiles(&received_job);
+    received_job.trace_id = trace_job_take();
+    memcpy(job, &received_job, sizeof(ImageJob));
+    memset(&received_job, 0, sizeof(ImageJob));
+    atomic_fetch_add(&pending_jobs, 1);
+    return job;
+}
+
+esp_err_t image_process_job(ImageJob* job) {
+    // Identical job, e.g., a print repeated by user, just counts another copy.
+    const uint32_t content_hash = job_content_hash(job);
+    esp_err_t result = ESP_OK;
+    bool published = false;
+    if (!reuse_published_image(job, content_hash)) {
+        // Bitmap and encoder buffers are released at once with arena reset.
+        pipeline_arena_begin();
+        result = admit_job(job);
+        if (result == ESP_OK) {
+            result = create_image(job, content_hash);
+            published = result == ESP_OK;
+        }
+        pipeline_arena_reset();
+    }
+    pipeline_heap_job_end();
+    if (published) {
+        // Job is released with published image.
+        atomic_fetch_sub(&pending_jobs, 1);
+    } else {
+        image_discard_job(job);
+    }
+    return result;
+}
+
+void image_discard_job(ImageJob* job) {
+    // Job of a reused image is already closed in trace, others end without one.
+    trace_job_fail(job->trace_id);
+    clear_job(job);
+    pipeline_free(job);
+    atomic_fetch_sub(&pending_jobs, 1);
+}
+
+int image_num_pending_jobs(void) { return atomic_load(&pending_jobs); }
+
+esp_err_t image_process(void) {
+    if (received_job.num_parts == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ImageJob* job = image_take_job();
+    if (job == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return image_process_job(job);
+}
+
+bool IRAM_ATTR image_png_ready(void) { return atomic_load(&published_snapshot) != NULL; }
+
+const ImageSnapshot* image_snapshot_acquire(void) { return acquire_published_snapshot(); }
+
+const ImageSnapshot* image_snapshot_acquire_id(uint32_t id) {
+    atomic_fetch_add(&active_readers, 1);
+    // Current image first, it might not be in history if removed meanwhile.
+    ImageSnapshot* found = atomic_load(&published_snapshot);
+    for (int i = 0; i < CONFIG_PRINTER_IMAGE_HISTORY && (found == NULL || found->hash != id);
+         ++i) {
+        found = atomic_load(&image_history[i]);
+    }
+    if (found != NULL && found->hash == id) {
+        atomic_fetch_add(&found->ref_count, 1);
+    } else {
+        found = NULL;
+    }
+    atomic_fetch_sub(&active_readers, 1);
+    return found;
+}
+
+size_t image_snapshot_ids(uint32_t* ids, size_t size) {
+    atomic_fetch_add(&active_readers, 1);
+    const unsigned int head = atomic_load(&history_head);
+    size_t count = 0;
+    for (int i = 0; i < CONFIG_PRINTER_IMAGE_HISTORY && count < size; ++i) {
+        const unsigned int slot =
+            (head + CONFIG_PRINTER_IMAGE_HISTORY - i) % CONFIG_PRINTER_IMAGE_HISTORY;
+        const ImageSnapshot* snapshot = atomic_load(&image_history[slot]);
+        if (snapshot != NULL) {
+            ids[count++] = snapshot->hash;
+        }
+    }
+    atomic_fetch_sub(&active_readers, 1);
+    return count;
+}
+
+void image_snapshot_release(const ImageSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+
+    ImageSnapshot* mutable_snapshot = (ImageSnapshot*)snapshot;
+    if (atomic_fetch_sub(&mutable_snapshot->ref_count, 1) == 1) {
+        if (mutable_snapshot->job != NULL) {
+            clear_job(mutable_snapshot->job);
+            pipeline_free(mutable_snapshot->job);
+        }
+        pipeline_free(mutable_snapshot->data);
+        pipeline_free(mutable_snapshot);
+    }
+}
 
 void image_png_clear(void) {
-    free(png_buffer);
-    png_buffer = NULL;
-    png_length = 0;
-}
\ No newline at end of file
+    ImageSnapshot* previous = atomic_exchange(&published_snapshot, NULL);
+    ImageSnapshot* removed[CONFIG_PRINTER_IMAGE_HISTORY];
+    for (int i = 0; i < CONFIG_PRINTER_IMAGE_HISTORY; ++i) {
+        removed[i] = atomic_exchange(&image_history[i], NULL);
+    }
+    wait_readers();
+    image_snapshot_release(previous);
+    for (int i = 0; i < CONFIG_PRINTER_IMAGE_HISTORY; ++i) {
+        image_snapshot_release(removed[i]);
+    }
+    esp_event_post(IMAGE_EVENT, IMAGE_EVENT_CLEARED, NULL, 0, 0);
+}
+
+#if CONFIG_PRINTER_BENCHMARK
+void image_benchmark_palette(const ImageData* image_data) {
+    uint8_t palette_lut[PALETTE_SIZE];
+    create_palette_lut(image_data->palette, image_data->exposure, palette_lut);
+}
+
+ImageJob* image_benchmark_job_create(void) {
+    return pipeline_calloc(PIPELINE_STAGE_PARTS, sizeof(ImageJob));
+}
+
+esp_err_t image_benchmark_add_data(ImageJob* job, const ImageData* image_data) {
+    PendingPart pending = {0};
+    // Refused data is reported once part is finished.
+    append_data(job, &pending, image_data->data, image_data->length);
+    esp_err_t result = finish_part(job, &pending, image_data->palette, image_data->exposure);
+    if (result != ESP_OK) {
+        reset_part(job, &pending);
+    }
+    return result;
+}
+
+void image_benchmark_job_free(ImageJob* job) {
+    if (job != NULL) {
+        clear_job(job);
+        pipeline_free(job);
+    }
+}
+
+size_t image_benchmark_unique_tiles(const ImageJob* job) { return job->num_unique_tiles; }
+
+esp_err_t image_benchmark_bitmap(const ImageJob* job, uint8_t** buffer, uint32_t* px_height) {
+    *buffer = NULL;
+    *px_height = 0;
+    esp_err_t result = create_bitmap(job, buffer, px_height);
+    if (result != ESP_OK) {
+        pipeline_free(*buffer);
+        *buffer = NULL;
+    }
+    return result;
+}
+
+esp_err_t image_benchmark_process(ImageJob* job, uint8_t** png_buffer, size_t* png_length) {
+    *png_buffer = NULL;
+    *png_length = 0;
+    pipeline_arena_begin();
+    uint8_t* arena_buffer = NULL;
+    esp_err_t result = admit_job(job);
+    if (result == ESP_OK) {
+        result = render_png(job, &arena_buffer, png_length);
+    }
+    if (result == ESP_OK) {
+        // Result is kept like published image, out of job arena.
+        *png_buffer = pipeline_persist(arena_buffer, *png_length, PIPELINE_STAGE_IMAGE);
+        if (*png_buffer == NULL) {
+            pipeline_free(arena_buffer);
+            result = ESP_ERR_NO_MEM;
+        }
+    }
+    pipeline_arena_reset();
+    pipeline_heap_job_end();
+    return result;
+}
+
+bool image_benchmark_same_content(const ImageJob* job, const ImageJob* other) {
+    return job_content_hash(job) == job_content_hash(other) && same_job_content(job, other);
+}
+
+enum ImageContent image_benchmark_content(const uint8_t* bitmap, uint32_t px_height) {
+    return classify_content(bitmap, px_height);
+}
+
+void image_benchmark_encode_options(ImageEncodeOptions* options) {
+    lodepng_compress_settings_init(&options->compression);
+    configure_compression(&options->compression);
+    options->filter = CONFIGURED_FILTER;
+}
+
+esp_err_t image_benchmark_encode(const uint8_t* bitmap, uint32_t px_height,
+                                 const ImageEncodeOptions* options, size_t* png_length) {
+    uint8_t* png_buffer = NULL;
+    ESP_ERROR_RETURN(encode_png(bitmap, px_height, options, &png_buffer, png_length));
+    pipeline_free(png_buffer);
+    return ESP_OK;
+}
+#endif
\ No newline at end of file
@@ -1,11 +1,26 @@
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include "esp_err.h"
+#include "esp_event.h"
+#include "lodepng.h"
+#include "sdkconfig.h"
 
 /// Buffer size for a single image.
 #define IMAGE_BUFFER_SIZE 0x2000
 
+/// @brief Image builder event base.
+ESP_EVENT_DECLARE_BASE(IMAGE_EVENT);
+
+/// @brief Image builder events.
+enum ImageEvent {
+    /// @brief PNG image is ready.
+    IMAGE_EVENT_READY,
+    /// @brief PNG image was removed.
+    IMAGE_EVENT_CLEARED
+};
+
 /// @brief Single image data.
 typedef struct {
     // Image parameters.
@@ -19,31 +34,214 @@ typedef struct {
     uint8_t data[IMAGE_BUFFER_SIZE];
 } ImageData;
 
+/// @brief Print job - image parts handed over for processing, see 'image_take_job'.
+typedef struct ImageJob ImageJob;
+
+/// @brief Finished PNG image.
+///        Snapshot data is immutable once published and stays valid until released. Only the
+///        atomic counters are updated afterwards, by image builder.
+typedef struct {
+    // Number of held references. Managed by image builder.
+    atomic_uint ref_count;
+    // Number of identical jobs the image was created from. Managed by image builder, grows
+    // while the snapshot is published.
+    atomic_uint copies;
+    // CRC-32 of PNG data. Used to identify images, e.g., as HTTP entity tag.
+    uint32_t hash;
+    // XXH32 of image data the image was created from.
+    uint32_t content_hash;
+    // Print job the image was created from, to recognize identical jobs. Managed by image
+    // builder, released once the image is no longer the current one.
+    ImageJob* job;
+    // PNG data and length.
+    size_t length;
+    uint8_t* data;
+} ImageSnapshot;
+
 /// @brief  Remove stored image data.
 void image_clear(void);
 
-/// @brief              Add image data.
-/// @param image_data   Data to be added. Data will be copied.
-/// @return             Error code.
+/// @brief          Append data to image part being received. Data can arrive in pieces of any
+///                 length, it is stored as it arrives. Repeated tiles are stored once.
+/// @param data     Data to be added. Data will be copied.
+/// @param length   Data length in bytes.
+/// @return         Error code. ESP_ERR_NO_MEM if part was refused to stay within heap budget,
+///                 its remaining data is dropped.
+esp_err_t image_append_data(const uint8_t* data, size_t length);
+
+/// @brief          Finish image part being received. Part might also be empty.
+/// @param palette  GB palette of the part.
+/// @param exposure Exposure of the part.
+/// @return         Error code. ESP_ERR_NO_MEM if part was refused to stay within heap budget.
+esp_err_t image_finish_part(uint8_t palette, uint8_t exposure);
+
+/// @brief  Drop data of image part being received.
+void image_discard_part(void);
+
+/// @brief              Add whole image part at once.
+/// @param image_data   Data to be added. Data will be copied, repeated tiles are stored once.
+/// @return             Error code. ESP_ERR_NO_MEM if part was refused to stay within heap budget.
 esp_err_t image_add_data(ImageData* image_data);
 
 /// @return Number of stored image parts.
 int image_num_parts(void);
 
-/// @brief  Process image data to create an image.
-///         Removes unprocessed data.
-/// @return Error code.
+/// @brief  Hand stored image parts over as a print job. Image builder starts a new job,
+///         parts can be added while the taken one is processed, e.g., by another task.
+///         Unfinished image part is dropped.
+/// @return Print job, must be passed to 'image_process_job'.
+///         NULL if there are no image parts, or if out of memory - image parts are dropped then.
+ImageJob* image_take_job(void);
+
+/// @brief      Process print job to create an image, then free the job.
+///             Published image is reused if created from identical data, only its copy count
+///             grows. Trailing image parts are dropped if there's not enough free heap to process
+///             all. Jobs must be processed one at a time.
+/// @param job  Print job taken with 'image_take_job'.
+/// @return     Error code.
+esp_err_t image_process_job(ImageJob* job);
+
+/// @brief      Drop print job without processing it.
+/// @param job  Print job taken with 'image_take_job'.
+void image_discard_job(ImageJob* job);
+
+/// @return Number of print jobs taken and not processed yet.
+int image_num_pending_jobs(void);
+
+/// @brief  Process stored image parts to create an image, at once.
+///         Same as 'image_process_job' of 'image_take_job'.
+/// @return Error code. ESP_ERR_INVALID_STATE if there are no image parts.
 esp_err_t image_process(void);
 
-/// @brief  Get length of image buffer.
-/// @return Length of PNG image buffer.
-///         0 if not ready.
-size_t image_png_length(void);
+/// @return True if PNG image is ready.
+bool image_png_ready(void);
 
-/// @brief  Get pointer to image buffer.
-/// @return Pointer to PNG image buffer.
+/// @brief  Acquire reference to current PNG image.
+///         Never blocks. Must be followed by 'image_snapshot_release'.
+/// @return Current PNG image snapshot.
 ///         NULL if not ready.
-const uint8_t* image_png_buffer(void);
+const ImageSnapshot* image_snapshot_acquire(void);
+
+/// @brief      Acquire reference to kept PNG image by its ID, see 'image_snapshot_ids'.
+///             Never blocks. Must be followed by 'image_snapshot_release'.
+/// @param id   Image ID - its hash.
+/// @return     PNG image snapshot. NULL if it's not kept.
+const ImageSnapshot* image_snapshot_acquire_id(uint32_t id);
+
+/// @brief      Get IDs of kept PNG images, newest first - the current one, followed by images
+///             of previous print jobs, up to 'CONFIG_PRINTER_IMAGE_HISTORY' in total.
+/// @param ids  Output - image IDs.
+/// @param size Max number of IDs.
+/// @return     Number of IDs.
+size_t image_snapshot_ids(uint32_t* ids, size_t size);
+
+/// @brief          Release reference to PNG image.
+///                 Snapshot is freed once last reference is released.
+/// @param snapshot Snapshot to release. NULL is ignored.
+void image_snapshot_release(const ImageSnapshot* snapshot);
+
+/// @brief  Remove current PNG image and all kept ones.
+///         Readers holding a reference can still use them.
+void image_png_clear(void);
+
+/// @brief PNG row filter strategies.
+enum ImageFilter {
+    /// @brief LodePNG default - no filter for palette images, minimum sum heuristic otherwise.
+    IMAGE_FILTER_AUTO,
+    /// @brief No filter on every row.
+    IMAGE_FILTER_NONE,
+    /// @brief Up filter on every row.
+    IMAGE_FILTER_UP,
+    /// @brief Up filter on rows repeating previous row, turning them into zeros.
+    ///        No filter otherwise.
+    IMAGE_FILTER_REPEATED_ROWS,
+    /// @brief Chosen for each print job by class of its content, see 'ImageContent'.
+    IMAGE_FILTER_CONTENT,
+    IMAGE_NUM_FILTERS
+};
 
-/// @brief  Clear PNG buffer and reset PNG buffer length.
-void image_png_clear(void);
\ No newline at end of file
+/// @brief Content classes of print jobs, telling row filter apart.
+enum ImageContent {
+    /// @brief All pixels of the same color. No filter, LZ77 matches the whole image anyway.
+    IMAGE_CONTENT_BLANK,
+    /// @brief Dithered photo, few rows repeat. No filter, Up filter spreads dithering over
+    ///        more distinct bytes.
+    IMAGE_CONTENT_PHOTO,
+    /// @brief At least half of rows repeat previous one, e.g., banners and upscaled text.
+    ///        Up filter for repeated rows.
+    IMAGE_CONTENT_REPEATED_ROWS,
+    IMAGE_NUM_CONTENT_CLASSES
+};
+
+/// @brief PNG encoder options.
+typedef struct {
+    LodePNGCompressSettings compression;
+    enum ImageFilter filter;
+} ImageEncodeOptions;
+
+#if CONFIG_PRINTER_BENCHMARK
+// Internal stages, exposed for benchmarking only.
+
+/// @brief              Classify content of bitmap, as done for 'IMAGE_FILTER_CONTENT'.
+/// @param bitmap       8bpp bitmap, 160 pixels wide.
+/// @param px_height    Bitmap height in pixels.
+/// @return             Content class.
+enum ImageContent image_benchmark_content(const uint8_t* bitmap, uint32_t px_height);
+
+/// @brief              Build palette lookup table of image data.
+/// @param image_data   Image data.
+void image_benchmark_palette(const ImageData* image_data);
+
+/// @brief  Create empty print job, built apart from image parts being received. It's never
+///         published, so benchmark leaves printer state untouched.
+/// @return Print job, NULL if out of memory. Must be freed with 'image_benchmark_job_free'.
+ImageJob* image_benchmark_job_create(void);
+
+/// @brief              Add whole image part to print job, as 'image_add_data' does.
+/// @param job          Print job created with 'image_benchmark_job_create'.
+/// @param image_data   Data to be added.
+/// @return             Error code.
+esp_err_t image_benchmark_add_data(ImageJob* job, const ImageData* image_data);
+
+/// @brief      Free print job created with 'image_benchmark_job_create'.
+/// @param job  Print job. NULL is ignored.
+void image_benchmark_job_free(ImageJob* job);
+
+/// @param job  Print job.
+/// @return     Number of unique tiles in the job.
+size_t image_benchmark_unique_tiles(const ImageJob* job);
+
+/// @brief              Create bitmap of print job.
+/// @param job          Print job.
+/// @param buffer       Output - 8bpp bitmap, 160 pixels wide. Must be freed with 'pipeline_free'.
+/// @param px_height    Output - bitmap height in pixels.
+/// @return             Error code.
+esp_err_t image_benchmark_bitmap(const ImageJob* job, uint8_t** buffer, uint32_t* px_height);
+
+/// @brief              Process print job as 'image_process_job' does, but keep the image
+///                     instead of publishing it.
+/// @param job          Print job. Trailing parts are dropped if they don't fit into free heap.
+/// @param png_buffer   Output - PNG data. Must be freed with 'pipeline_free'.
+/// @param png_length   Output - PNG data length.
+/// @return             Error code.
+esp_err_t image_benchmark_process(ImageJob* job, uint8_t** png_buffer, size_t* png_length);
+
+/// @brief          Check if jobs are identical, as done to reuse published image.
+/// @param job      Print job.
+/// @param other    Print job to compare with.
+/// @return         True if both jobs have identical image parts.
+bool image_benchmark_same_content(const ImageJob* job, const ImageJob* other);
+
+/// @brief              Get PNG encoder options, as configured.
+/// @param options      Output - encoder options.
+void image_benchmark_encode_options(ImageEncodeOptions* options);
+
+/// @brief              Encode bitmap as PNG and discard the result.
+/// @param bitmap       8bpp bitmap, 160 pixels wide.
+/// @param px_height    Bitmap height in pixels.
+/// @param options      Encoder options. NULL to use configured ones.
+/// @param png_length   Output - PNG data length.
+/// @return             Error code.
+esp_err_t image_benchmark_encode(const uint8_t* bitmap, uint32_t px_height,
+                                 const ImageEncodeOptions* options, size_t* png_length);
+#endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "isr_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PRINTER_ISR_PROFILING
+
+static const char* TAG = "ISR_PROFILER";
+
+#define NUM_BUCKETS 128
+// Bucket width of ISR duration histograms: 32 cycles.
+#define DURATION_BUCKET_SHIFT 5
+// Bucket width of clock period histogram: 512 cycles.
+#define PERIOD_BUCKET_SHIFT 9
+
+/// @brief Linear histogram of cycle counts.
+typedef struct {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+} CycleHistogram;
+
+static CycleHistogram duration_histograms[ISR_NUM_PATHS];
+static CycleHistogram period_histogram;
+static uint32_t last_entry_cycles = 0;
+static uint32_t logged_count = 0;
+
+static const char* path_names[ISR_NUM_PATHS] = {
+    [ISR_PATH_BIT] = "bit",
+    [ISR_PATH_SYNC] = "sync",
+    [ISR_PATH_BYTE] = "byte",
+    [ISR_PATH_CHECKSUM] = "checksum",
+    [ISR_PATH_STATUS] = "status",
+};
+
+static void IRAM_ATTR observe(CycleHistogram* histogram, uint32_t shift, uint32_t cycles) {
+    uint32_t bucket = cycles >> shift;
+    if (bucket >= NUM_BUCKETS) {
+        bucket = NUM_BUCKETS - 1;
+    }
+    ++histogram->buckets[bucket];
+    if (histogram->count == 0 || cycles < histogram->min) {
+        histogram->min = cycles;
+    }
+    if (cycles > histogram->max) {
+        histogram->max = cycles;
+    }
+    ++histogram->count;
+}
+
+void IRAM_ATTR isr_profiler_record(enum IsrPath path, uint32_t entry_cycles,
+                                   uint32_t exit_cycles, bool intra_byte) {
+    observe(&duration_histograms[path], DURATION_BUCKET_SHIFT, exit_cycles - entry_cycles);
+    if (intra_byte) {
+        observe(&period_histogram, PERIOD_BUCKET_SHIFT, entry_cycles - last_entry_cycles);
+    }
+    last_entry_cycles = entry_cycles;
+}
+
+/// @brief  Get percentile from histogram.
+/// @return Upper bound of bucket containing percentile, limited to max value.
+static uint32_t percentile(const CycleHistogram* histogram, uint32_t shift, uint32_t permille) {
+    const uint64_t target = ((uint64_t)histogram->count * permille + 999) / 1000;
+    uint64_t cumulative = 0;
+    for (uint32_t b = 0; b < NUM_BUCKETS; ++b) {
+        cumulative += histogram->buckets[b];
+        if (cumulative >= target) {
+            const uint32_t upper_bound = ((b + 1) << shift) - 1;
+            return upper_bound < histogram->max ? upper_bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static size_t format_row(char* buffer, size_t size, size_t length, const char* name,
+                         const CycleHistogram* histogram, uint32_t shift) {
+    const size_t offset = length < size ? length : size;
+    if (histogram->count == 0) {
+        return length + snprintf(buffer + offset, size - offset, "%-9s %10d\n", name, 0);
+    }
+    return length + snprintf(buffer + offset, size - offset,
+                             "%-9s %10lu %7lu %7lu %7lu %7lu %7lu %7lu\n", name, histogram->count,
+                             histogram->min, percentile(histogram, shift, 500),
+                             percentile(histogram, shift, 900), percentile(histogram, shift, 990),
+                             percentile(histogram, shift, 999), histogram->max);
+}
+
+size_t isr_profiler_format(char* buffer, size_t size) {
+    size_t length = snprintf(buffer, size, "CPU frequency: %d MHz, values in cycles\n",
+                             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    const size_t offset = length < size ? length : size;
+    length += snprintf(buffer + offset, size - offset, "%-9s %10s %7s %7s %7s %7s %7s %7s\n",
+                       "path", "count", "min", "p50", "p90", "p99", "p99.9", "max");
+    for (int i = 0; i < ISR_NUM_PATHS; ++i) {
+        length = format_row(buffer, size, length, path_names[i], &duration_histograms[i],
+                            DURATION_BUCKET_SHIFT);
+    }
+    return format_row(buffer, size, length, "period", &period_histogram, PERIOD_BUCKET_SHIFT);
+}
+
+void isr_profiler_log(void) {
+    uint32_t count = period_histogram.count;
+    for (int i = 0; i < ISR_NUM_PATHS; ++i) {
+        count += duration_histograms[i].count;
+    }
+    if (count == logged_count) {
+        return;
+    }
+    logged_count = count;
+
+    char text[640];
+    isr_profiler_format(text, sizeof(text));
+    ESP_LOGI(TAG, "Clock ISR profile:\n%s", text);
+}
+
+void isr_profiler_reset(void) {
+    memset(duration_histograms, 0, sizeof(duration_histograms));
+    memset(&period_histogram, 0, sizeof(period_histogram));
+    logged_count = 0;
+}
+
+#endif
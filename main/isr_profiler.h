@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Clock ISR code paths.
+enum IsrPath {
+    /// @brief Bit shifted in and out, no further processing.
+    ISR_PATH_BIT,
+    /// @brief Sync word detected.
+    ISR_PATH_SYNC,
+    /// @brief Byte boundary - byte processed.
+    ISR_PATH_BYTE,
+    /// @brief Byte boundary - checksum verified.
+    ISR_PATH_CHECKSUM,
+    /// @brief Byte boundary - status prepared for sending.
+    ISR_PATH_STATUS,
+    ISR_NUM_PATHS
+};
+
+/// @brief              Record single clock ISR execution.
+///                     Must be called from clock ISR only.
+/// @param path         Code path taken by the ISR.
+/// @param entry_cycles CPU cycle count at ISR entry.
+/// @param exit_cycles  CPU cycle count at ISR exit.
+/// @param intra_byte   True if previous clock edge belongs to the same byte.
+///                     Only such edges are used to measure clock period.
+void isr_profiler_record(enum IsrPath path, uint32_t entry_cycles, uint32_t exit_cycles,
+                         bool intra_byte);
+
+/// @brief          Write ISR profile as text table.
+///                 Values are approximate - histograms are updated while reading.
+/// @param buffer   Output buffer. Output is always null-terminated.
+/// @param size     Size of output buffer.
+/// @return         Length of the output, excluding null terminator.
+size_t isr_profiler_format(char* buffer, size_t size);
+
+/// @brief Log ISR profile, if new samples were recorded since last call.
+void isr_profiler_log(void);
+
+/// @brief Remove all recorded samples.
+void isr_profiler_reset(void);
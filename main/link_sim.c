@@ -0,0 +1,392 @@
+#include "link_sim.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "image_builder.h"
+#include "printer.h"
+
+#if CONFIG_PRINTER_LINK_SIMULATOR
+
+static const char* TAG = "LINK_SIM";
+
+// Size of a full data packet - two rows of tiles.
+#define PACKET_DATA_SIZE 0x280
+// Max number of data packets per print, limited by memory of real printer.
+#define MAX_PACKETS_PER_PRINT (IMAGE_BUFFER_SIZE / PACKET_DATA_SIZE)
+// Number of data packets of streamed print, beyond memory of real printer.
+#define STREAM_PACKETS_PER_PRINT 16
+// Status is polled with this interval while printer is busy.
+#define STATUS_POLL_INTERVAL_MS 20
+#define STATUS_POLL_TIMEOUT_MS  5000
+// GB gives up waiting for a print that doesn't start within this time and goes on.
+// Chosen for the simulator, not measured on a game.
+#define PRINT_START_TIMEOUT_MS 100
+// Max time to wait for image after last byte.
+#define IMAGE_TIMEOUT_MS 10000
+// Max number of retransmissions of a single packet.
+#define MAX_RETRIES 3
+
+/// @brief Scenario parameters.
+typedef struct {
+    const char* name;
+    // Number of print commands.
+    int num_prints;
+    // Number of full data packets per print.
+    int packets_per_print;
+    // Margins of first, middle and last print.
+    uint8_t first_margins;
+    uint8_t middle_margins;
+    uint8_t last_margins;
+    // Every n-th data packet is sent with corrupted checksum. 0 to disable.
+    int corrupt_every;
+    // Run with turbo mode off first, for comparison.
+    bool compare_turbo;
+} ScenarioInfo;
+
+static const ScenarioInfo scenarios[LINK_SIM_NUM_SCENARIOS] = {
+    [LINK_SIM_SINGLE_PHOTO] = {"single", 1, 9, 0x13, 0x13, 0x13, 0},
+    [LINK_SIM_PRINT_ALL] = {"print-all", 30, 9, 0x13, 0x13, 0x13, 0},
+    [LINK_SIM_BANNER] = {"banner", 8, MAX_PACKETS_PER_PRINT, 0x10, 0x00, 0x03, 0},
+    [LINK_SIM_CORRUPTED_CHECKSUMS] = {"corrupted", 1, 9, 0x13, 0x13, 0x13, 4},
+    [LINK_SIM_STREAM] = {"stream", 1, STREAM_PACKETS_PER_PRINT, 0x13, 0x13, 0x13, 0},
+    [LINK_SIM_TURBO_COMPARISON] = {"turbo-compare", 30, 9, 0x13, 0x13, 0x13, 0, true},
+};
+
+/// @brief Simulation results.
+typedef struct {
+    const char* scenario;
+    esp_err_t result;
+    uint32_t bytes;
+    uint32_t packets;
+    uint32_t retries;
+    // Print commands whose status already reported printing.
+    uint32_t print_acks;
+    // Prints seen printing, then finished.
+    uint32_t prints_finished;
+    // Prints GB gave up on, printing wasn't seen in time.
+    uint32_t print_start_timeouts;
+    // Printer was in turbo mode.
+    bool turbo;
+    // Time from first to last byte.
+    int64_t link_us;
+    // Time spent polling status until prints were finished, part of link time.
+    int64_t print_wait_us;
+    // Time from last byte to image being ready.
+    int64_t time_to_image_us;
+    // Link and print wait time, and finished prints of the run with turbo mode off, when
+    // comparing.
+    int64_t turbo_off_link_us;
+    int64_t turbo_off_print_wait_us;
+    uint32_t turbo_off_prints_finished;
+} LinkSimResults;
+
+/// @brief Simulation task parameters.
+typedef struct {
+    enum LinkSimScenario scenario;
+    uint32_t byte_interval_us;
+} LinkSimParams;
+
+static LinkSimResults results = {};
+static LinkSimParams params = {};
+// Simulation task is running. Results are complete once it's cleared.
+static atomic_bool running = false;
+
+static uint8_t exchange(uint8_t byte) {
+    if (params.byte_interval_us > 0) {
+        esp_rom_delay_us(params.byte_interval_us);
+    }
+    ++results.bytes;
+    return printer_simulation_exchange(byte);
+}
+
+/// @brief          Send single packet.
+/// @param command  Packet command.
+/// @param data     Packet data. Can be NULL if 'length' is 0.
+/// @param length   Packet data length.
+/// @param corrupt  Send invalid checksum.
+/// @return         Printer status byte, received at the end of the packet.
+static uint8_t send_packet(uint8_t command, const uint8_t* data, uint16_t length, bool corrupt) {
+    // Sync word.
+    exchange(0x88);
+    exchange(0x33);
+
+    // Header.
+    const uint8_t header[] = {command, 0x00, length & 0xFF, length >> 8};
+    uint16_t checksum = 0;
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        exchange(header[i]);
+        checksum += header[i];
+    }
+
+    // Data.
+    for (uint16_t i = 0; i < length; ++i) {
+        exchange(data[i]);
+        checksum += data[i];
+    }
+
+    // Checksum.
+    if (corrupt) {
+        checksum = ~checksum;
+    }
+    exchange(checksum & 0xFF);
+    exchange(checksum >> 8);
+
+    // Acknowledgement, then status.
+    const uint8_t ack = exchange(0x00);
+    const uint8_t status = exchange(0x00);
+    if (ack != 0x81) {
+        ESP_LOGW(TAG, "Unexpected acknowledgement: %02x", ack);
+    }
+    ++results.packets;
+    return status;
+}
+
+/// @brief  Poll status until printer has room for more data.
+static esp_err_t wait_data_accepted(void) {
+    for (int elapsed_ms = 0; elapsed_ms < STATUS_POLL_TIMEOUT_MS;
+         elapsed_ms += STATUS_POLL_INTERVAL_MS) {
+        if (!(send_packet(0x0F, NULL, 0, false) & STATUS_DATA_FULL)) {
+            return ESP_OK;
+        }
+        vTaskDelay(pdMS_TO_TICKS(STATUS_POLL_INTERVAL_MS));
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+/// @brief Send packet, retransmit if printer reports checksum error.
+static uint8_t send_packet_with_retries(uint8_t command, const uint8_t* data, uint16_t length,
+                                        bool corrupt) {
+    uint8_t status = send_packet(command, data, length, corrupt);
+    for (int retry = 0; retry < MAX_RETRIES && (status & STATUS_CHECKSUM_ERROR); ++retry) {
+        ++results.retries;
+        // Data not fitting printer memory is reported as checksum error, wait for room first.
+        if ((status & STATUS_DATA_FULL) && wait_data_accepted() != ESP_OK) {
+            break;
+        }
+        status = send_packet(command, data, length, false);
+    }
+    return status;
+}
+
+/// @brief              Poll status until print is finished, as games do.
+///                     Print is finished once printing flag was raised, then cleared.
+///                     GB gives up if printing isn't seen within 'PRINT_START_TIMEOUT_MS'.
+/// @param print_status Status received in response to print command.
+/// @param started      Output - printing was seen.
+/// @return             Error code. ESP_ERR_TIMEOUT if print started, but didn't finish.
+static esp_err_t wait_print_finished(uint8_t print_status, bool* started) {
+    *started = print_status & STATUS_CURRENTLY_PRINTING;
+    for (int elapsed_ms = 0; elapsed_ms < STATUS_POLL_TIMEOUT_MS;
+         elapsed_ms += STATUS_POLL_INTERVAL_MS) {
+        if (!*started && elapsed_ms >= PRINT_START_TIMEOUT_MS) {
+            return ESP_OK;
+        }
+        const bool printing = send_packet(0x0F, NULL, 0, false) & STATUS_CURRENTLY_PRINTING;
+        if (printing) {
+            *started = true;
+        } else if (*started) {
+            return ESP_OK;
+        }
+        vTaskDelay(pdMS_TO_TICKS(STATUS_POLL_INTERVAL_MS));
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+/// @brief Fill packet with synthetic tile data, different for every print and packet.
+static void fill_packet(uint8_t* data, int print, int packet) {
+    for (int i = 0; i < PACKET_DATA_SIZE; i += 2) {
+        const int tile = i / 16;
+        const int row = (i % 16) / 2;
+        data[i] = ((tile + packet + print) & 0x01) ? 0xFF : (0x0F << (row & 0x03));
+        data[i + 1] = ((tile + row + print) & 0x02) ? 0xAA : 0x55;
+    }
+}
+
+static esp_err_t run_scenario(const ScenarioInfo* info) {
+    uint8_t* data = malloc(PACKET_DATA_SIZE);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t result = ESP_OK;
+    int data_packet_index = 0;
+    const int64_t start_us = esp_timer_get_time();
+    for (int print = 0; print < info->num_prints && result == ESP_OK; ++print) {
+        // Initialize.
+        send_packet_with_retries(0x01, NULL, 0, false);
+
+        // Data packets, terminated with empty data packet, as GB Camera does.
+        for (int packet = 0; packet < info->packets_per_print && result == ESP_OK; ++packet) {
+            fill_packet(data, print, packet);
+            ++data_packet_index;
+            const bool corrupt =
+                info->corrupt_every > 0 && data_packet_index % info->corrupt_every == 0;
+            const uint8_t status = send_packet_with_retries(0x04, data, PACKET_DATA_SIZE, corrupt);
+
+            // Flow control - wait until printer has room for next packet.
+            if (status & STATUS_DATA_FULL) {
+                result = wait_data_accepted();
+            }
+        }
+        if (result != ESP_OK) {
+            break;
+        }
+        send_packet_with_retries(0x04, NULL, 0, false);
+
+        // Print - sheets, margins, palette, exposure.
+        uint8_t margins = info->middle_margins;
+        if (print == 0) {
+            margins = info->first_margins;
+        } else if (print == info->num_prints - 1) {
+            margins = info->last_margins;
+        }
+        const uint8_t print_data[] = {0x01, margins, 0xE4, 0x40};
+        const uint8_t print_status =
+            send_packet_with_retries(0x02, print_data, sizeof(print_data), false);
+
+        // Wait until print is finished.
+        const int64_t wait_start_us = esp_timer_get_time();
+        bool started = false;
+        result = wait_print_finished(print_status, &started);
+        results.print_wait_us += esp_timer_get_time() - wait_start_us;
+        if (print_status & STATUS_CURRENTLY_PRINTING) {
+            ++results.print_acks;
+        }
+        if (!started) {
+            ++results.print_start_timeouts;
+        } else if (result == ESP_OK) {
+            ++results.prints_finished;
+        }
+    }
+    const int64_t end_us = esp_timer_get_time();
+    results.link_us = end_us - start_us;
+    free(data);
+
+    return result;
+}
+
+/// @brief  Run scenario as a single link session, then wait for the image.
+static esp_err_t run_session(const ScenarioInfo* info) {
+    // Start from empty printer.
+    image_png_clear();
+
+    esp_err_t result = printer_simulation_begin();
+    if (result == ESP_OK) {
+        result = run_scenario(info);
+        printer_simulation_end();
+    }
+
+    // Wait for image, created once link is idle.
+    const int64_t last_byte_us = esp_timer_get_time();
+    if (result == ESP_OK) {
+        result = ESP_ERR_TIMEOUT;
+        for (int elapsed_ms = 0; elapsed_ms < IMAGE_TIMEOUT_MS; elapsed_ms += 10) {
+            if (image_png_ready()) {
+                results.time_to_image_us = esp_timer_get_time() - last_byte_us;
+                result = ESP_OK;
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    return result;
+}
+
+static void link_sim_task(UNUSED void* arg) {
+    const ScenarioInfo* info = &scenarios[params.scenario];
+    ESP_LOGI(TAG, "Running scenario: %s", info->name);
+
+    esp_err_t result = ESP_OK;
+    if (info->compare_turbo) {
+        const bool turbo_mode = printer_turbo_mode();
+        printer_set_turbo_mode(false);
+        result = run_session(info);
+        results.turbo_off_link_us = results.link_us;
+        results.turbo_off_print_wait_us = results.print_wait_us;
+        results.turbo_off_prints_finished = results.prints_finished;
+
+        // Remaining results are those of the run with turbo mode on.
+        if (result == ESP_OK) {
+            results.bytes = 0;
+            results.packets = 0;
+            results.retries = 0;
+            results.print_acks = 0;
+            results.prints_finished = 0;
+            results.print_start_timeouts = 0;
+            results.print_wait_us = 0;
+            results.time_to_image_us = 0;
+            results.turbo = true;
+            printer_set_turbo_mode(true);
+            result = run_session(info);
+        }
+        printer_set_turbo_mode(turbo_mode);
+    } else {
+        result = run_session(info);
+    }
+
+    results.result = result;
+    ESP_LOGI(TAG, "Scenario %s finished: %s, %lu bytes, %lld us, image after %lld us", info->name,
+             esp_err_to_name(result), results.bytes, results.link_us, results.time_to_image_us);
+    atomic_store(&running, false);
+    vTaskDelete(NULL);
+}
+
+esp_err_t link_sim_start(enum LinkSimScenario scenario, uint32_t byte_interval_us) {
+    if (scenario >= LINK_SIM_NUM_SCENARIOS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (atomic_exchange(&running, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(&results, 0, sizeof(results));
+    results.scenario = scenarios[scenario].name;
+    results.turbo = printer_turbo_mode();
+    params.scenario = scenario;
+    params.byte_interval_us = byte_interval_us;
+    if (xTaskCreate(link_sim_task, "link_sim_task", 4096, NULL, 1, NULL) != pdPASS) {
+        atomic_store(&running, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool link_sim_running(void) { return atomic_load(&running); }
+
+esp_err_t link_sim_scenario_from_name(const char* name, enum LinkSimScenario* scenario) {
+    for (int i = 0; i < LINK_SIM_NUM_SCENARIOS; ++i) {
+        if (strcmp(name, scenarios[i].name) == 0) {
+            *scenario = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+size_t link_sim_format_results(char* buffer, size_t size) {
+    // Throughput in bytes per second, over the whole link session.
+    const uint32_t throughput =
+        results.link_us > 0 ? (uint64_t)results.bytes * 1000000 / results.link_us : 0;
+    return snprintf(buffer, size,
+                    "{\"scenario\":\"%s\",\"running\":%d,\"turbo\":%d,\"result\":\"%s\","
+                    "\"bytes\":%lu,\"packets\":%lu,\"retries\":%lu,\"print_acks\":%lu,"
+                    "\"prints_finished\":%lu,\"print_start_timeouts\":%lu,\"link_us\":%lld,"
+                    "\"print_wait_us\":%lld,\"throughput_bps\":%lu,\"time_to_image_us\":%lld,"
+                    "\"turbo_off_link_us\":%lld,\"turbo_off_print_wait_us\":%lld,"
+                    "\"turbo_off_prints_finished\":%lu}",
+                    results.scenario != NULL ? results.scenario : "", atomic_load(&running),
+                    results.turbo, esp_err_to_name(results.result), results.bytes,
+                    results.packets, results.retries, results.print_acks, results.prints_finished,
+                    results.print_start_timeouts, results.link_us, results.print_wait_us,
+                    throughput, results.time_to_image_us, results.turbo_off_link_us,
+                    results.turbo_off_print_wait_us, results.turbo_off_prints_finished);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/// @brief Link simulator scenarios.
+enum LinkSimScenario {
+    /// @brief Single GB Camera photo.
+    LINK_SIM_SINGLE_PHOTO,
+    /// @brief GB Camera "print all" - 30 photos printed back to back.
+    LINK_SIM_PRINT_ALL,
+    /// @brief Long banner - many data packets printed as one image.
+    LINK_SIM_BANNER,
+    /// @brief Single photo with every 4th data packet sent with corrupted checksum.
+    LINK_SIM_CORRUPTED_CHECKSUMS,
+    /// @brief Single print with more data than a real printer holds, streamed with flow control.
+    LINK_SIM_STREAM,
+    /// @brief GB Camera "print all" run with turbo mode off, then on. Turbo mode is restored.
+    LINK_SIM_TURBO_COMPARISON,
+    LINK_SIM_NUM_SCENARIOS
+};
+
+/// @brief                  Start simulation in background task.
+///                         Simulated GB drives the printer as real one would over link cable.
+///                         Removes currently stored image.
+/// @param scenario         Scenario to run.
+/// @param byte_interval_us Time between consecutive bytes. 0 to send as fast as possible.
+/// @return                 Error code. ESP_ERR_INVALID_STATE if simulation is already running.
+esp_err_t link_sim_start(enum LinkSimScenario scenario, uint32_t byte_interval_us);
+
+/// @return True if simulation is running, results are complete otherwise.
+bool link_sim_running(void);
+
+/// @brief          Find scenario by name.
+/// @param name     Scenario name, e.g., "single", "print-all", "banner", "corrupted",
+///                 "stream", "turbo-compare".
+/// @param scenario Output - found scenario.
+/// @return         Error code. ESP_ERR_NOT_FOUND if scenario is unknown.
+esp_err_t link_sim_scenario_from_name(const char* name, enum LinkSimScenario* scenario);
+
+/// @brief          Write results of last simulation as JSON.
+/// @param buffer   Output buffer. Output is always null-terminated.
+/// @param size     Size of output buffer.
+/// @return         Length of the output, excluding null terminator.
+size_t link_sim_format_results(char* buffer, size_t size);
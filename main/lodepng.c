@@ -1496,10 +1496,41 @@ typedef struct Hash {
   int* headz; /*similar to head, but for chainz*/
   unsigned short* chainz; /*those with same amount of zeros*/
   unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+
+  /*compact matcher, used instead of the above if hashbits is non-zero*/
+  unsigned hashbits;
+  unsigned short* head16; /*hash value to circular pos + 1, 0 if empty*/
+  unsigned short* prev16; /*circular pos to previous circular pos + 1 with same hash, 0 if none*/
 } Hash;
 
-static unsigned hash_init(Hash* hash, unsigned windowsize) {
+static unsigned hash_init_compact(Hash* hash, unsigned windowsize, unsigned hashbits) {
+  size_t numheads;
+  if(hashbits > 16) hashbits = 16;
+  numheads = (size_t)1u << hashbits;
+  hash->head = 0;
+  hash->val = 0;
+  hash->chain = 0;
+  hash->zeros = 0;
+  hash->headz = 0;
+  hash->chainz = 0;
+
+  hash->hashbits = hashbits;
+  hash->head16 = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * numheads);
+  hash->prev16 = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
+  if(!hash->head16 || !hash->prev16) return 83; /*alloc fail*/
+
+  lodepng_memset(hash->head16, 0, sizeof(unsigned short) * numheads);
+  lodepng_memset(hash->prev16, 0, sizeof(unsigned short) * windowsize);
+  return 0;
+}
+
+static unsigned hash_init(Hash* hash, unsigned windowsize, unsigned hashbits) {
   unsigned i;
+  if(hashbits) return hash_init_compact(hash, windowsize, hashbits);
+  hash->hashbits = 0;
+  hash->head16 = 0;
+  hash->prev16 = 0;
+
   hash->head = (int*)lodepng_malloc(sizeof(int) * HASH_NUM_VALUES);
   hash->val = (int*)lodepng_malloc(sizeof(int) * windowsize);
   hash->chain = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
@@ -1531,6 +1562,9 @@ static void hash_cleanup(Hash* hash) {
   lodepng_free(hash->zeros);
   lodepng_free(hash->headz);
   lodepng_free(hash->chainz);
+
+  lodepng_free(hash->head16);
+  lodepng_free(hash->prev16);
 }
 
 
@@ -1575,6 +1609,94 @@ static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned
   hash->headz[numzeros] = (int)wpos;
 }
 
+/*4-byte multiplicative hash of the compact matcher, pos + 4 must not exceed the data size*/
+static unsigned getHash4(const unsigned char* data, size_t pos, unsigned hashbits) {
+  unsigned value = (unsigned)data[pos + 0] | ((unsigned)data[pos + 1] << 8u) |
+                   ((unsigned)data[pos + 2] << 16u) | ((unsigned)data[pos + 3] << 24u);
+  return ((value * 2654435761u) & 0xffffffffu) >> (32u - hashbits);
+}
+
+static void updateHashChainCompact(Hash* hash, const unsigned char* in, size_t insize,
+                                   size_t pos, unsigned windowsize) {
+  if(pos + 4 <= insize) {
+    size_t wpos = pos & (windowsize - 1);
+    unsigned hashval = getHash4(in, pos, hash->hashbits);
+    hash->prev16[wpos] = hash->head16[hashval];
+    hash->head16[hashval] = (unsigned short)(wpos + 1);
+  }
+}
+
+/*
+LZ77-encode the data with the compact matcher: greedy matching, following at most maxchainlength
+links of the 4-byte hash chain. Tuned for filtered 2bpp image rows, which repeat a lot, so long matches
+are found within a short chain. Same output format as encodeLZ77.
+*/
+static unsigned encodeLZ77Compact(uivector* out, Hash* hash,
+                                  const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
+                                  unsigned minmatch, unsigned nicematch, unsigned maxchainlength) {
+  size_t pos;
+  unsigned i;
+
+  if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
+  if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+
+  if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
+  if(maxchainlength == 0) maxchainlength = 1;
+
+  for(pos = inpos; pos < insize; ++pos) {
+    unsigned length = 0;
+    unsigned offset = 0;
+
+    if(pos + 4 <= insize) {
+      size_t wpos = pos & (windowsize - 1);
+      unsigned next = hash->head16[getHash4(in, pos, hash->hashbits)];
+      unsigned chainlength = 0;
+      unsigned prev_offset = 0;
+      const unsigned char* lastptr =
+          &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH ? insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
+
+      while(next != 0 && chainlength++ < maxchainlength) {
+        size_t hashpos = next - 1;
+        unsigned current_offset = (unsigned)(hashpos < wpos ? wpos - hashpos : wpos - hashpos + windowsize);
+        const unsigned char* foreptr = &in[pos];
+        const unsigned char* backptr;
+        unsigned current_length;
+
+        /*offsets grow along the chain, stop when a link was overwritten after going around the window*/
+        if(current_offset <= prev_offset || current_offset > pos) break;
+        prev_offset = current_offset;
+
+        /*entries can be outdated, so bytes are always compared*/
+        backptr = &in[pos - current_offset];
+        while(foreptr != lastptr && *backptr == *foreptr) {
+          ++backptr;
+          ++foreptr;
+        }
+        current_length = (unsigned)(foreptr - &in[pos]);
+        if(current_length > length) {
+          length = current_length;
+          offset = current_offset;
+          if(current_length >= nicematch) break;
+        }
+
+        next = hash->prev16[hashpos];
+      }
+    }
+
+    /*encode it as length/distance pair or literal value*/
+    if(length < 3 || length < minmatch || (length == 3 && offset > 4096)) {
+      if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+      updateHashChainCompact(hash, in, insize, pos, windowsize);
+    } else {
+      addLengthDistance(out, length, offset);
+      for(i = 0; i != length; ++i) updateHashChainCompact(hash, in, insize, pos + i, windowsize);
+      pos += length - 1;
+    }
+  }
+
+  return 0;
+}
+
 /*
 LZ77-encode the data. Return value is error code. The input are raw bytes, the output
 is in the form of unsigned integers with codes representing for example literal bytes, or
@@ -1733,6 +1855,18 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+/*LZ77-encode the data with the matcher the hash was initialized for*/
+static unsigned encodeLZ77Settings(uivector* out, Hash* hash,
+                                   const unsigned char* in, size_t inpos, size_t insize,
+                                   const LodePNGCompressSettings* settings) {
+  if(hash->hashbits) {
+    return encodeLZ77Compact(out, hash, in, inpos, insize, settings->windowsize,
+                             settings->minmatch, settings->nicematch, settings->maxchainlength);
+  }
+  return encodeLZ77(out, hash, in, inpos, insize, settings->windowsize,
+                    settings->minmatch, settings->nicematch, settings->lazymatching);
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
 static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize) {
@@ -1859,8 +1993,7 @@ static unsigned deflateDynamic(LodePNGBitWriter* writer, Hash* hash,
     lodepng_memset(frequencies_cl, 0, NUM_CODE_LENGTH_CODES * sizeof(*frequencies_cl));
 
     if(settings->use_lz77) {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     } else {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
@@ -2045,8 +2178,7 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
     if(settings->use_lz77) /*LZ77 encoded*/ {
       uivector lz77_encoded;
       uivector_init(&lz77_encoded);
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(!error) writeLZ77data(writer, &lz77_encoded, &tree_ll, &tree_d);
       uivector_cleanup(&lz77_encoded);
     } else /*no LZ77, but still will be Huffman compressed*/ {
@@ -2076,7 +2208,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
   if(settings->btype > 2) return 61;
   else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  else if(settings->btype == 1) blocksize = insize ? insize : 1; /*empty input still gets its final block*/
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
     blocksize = insize / 8u + 8;
@@ -2087,7 +2219,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   numdeflateblocks = (insize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
+  error = hash_init(&hash, settings->windowsize, settings->hashbits);
 
   if(!error) {
     for(i = 0; i != numdeflateblocks && !error; ++i) {
@@ -2134,16 +2266,115 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+#if defined(__AVX2__) || defined(__SSSE3__)
+/*Host builds only, selected at compile time with -mavx2 or -mssse3. ESP32 has neither and uses the
+scalar loop below. Sums 32-byte blocks, len must be a multiple of 32. Follows zlib's SIMD variant:
+s2 gains 32 * s1 per block and byte weights 32..1 within the block.*/
+#include <immintrin.h>
+
+static unsigned update_adler32_simd(unsigned adler, const unsigned char* data, unsigned len) {
   unsigned s1 = adler & 0xffffu;
   unsigned s2 = (adler >> 16u) & 0xffffu;
+  unsigned blocks = len >> 5u;
+
+  while(blocks != 0u) {
+    /*5552 / 32 blocks at most, so that the sums don't overflow before the modulo*/
+    unsigned n = blocks > 173u ? 173u : blocks;
+    blocks -= n;
+#if defined(__AVX2__)
+    {
+      const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                           16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i ones = _mm256_set1_epi16(1);
+      /*v_ps accumulates s1 before each block, it's multiplied by 32 at the end*/
+      __m256i v_ps = _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+      __m256i v_s2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+      __m256i v_s1 = zero;
+      __m128i sum1, sum2;
+      do {
+        const __m256i bytes = _mm256_loadu_si256((const __m256i*)data);
+        v_ps = _mm256_add_epi32(v_ps, v_s1);
+        v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+        data += 32;
+      } while(--n);
+      v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+      sum1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+      sum2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+      sum1 = _mm_add_epi32(sum1, _mm_shuffle_epi32(sum1, _MM_SHUFFLE(2, 3, 0, 1)));
+      sum1 = _mm_add_epi32(sum1, _mm_shuffle_epi32(sum1, _MM_SHUFFLE(1, 0, 3, 2)));
+      sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(2, 3, 0, 1)));
+      sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(1, 0, 3, 2)));
+      s1 += (unsigned)_mm_cvtsi128_si32(sum1);
+      s2 = (unsigned)_mm_cvtsi128_si32(sum2);
+    }
+#else
+    {
+      const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+      const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i ones = _mm_set1_epi16(1);
+      __m128i v_ps = _mm_setr_epi32((int)(s1 * n), 0, 0, 0);
+      __m128i v_s2 = _mm_setr_epi32((int)s2, 0, 0, 0);
+      __m128i v_s1 = zero;
+      do {
+        const __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+        const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+        v_ps = _mm_add_epi32(v_ps, v_s1);
+        v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+        v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+        v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+        v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+        data += 32;
+      } while(--n);
+      v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+      v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+      v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+      v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+      v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+      s1 += (unsigned)_mm_cvtsi128_si32(v_s1);
+      s2 = (unsigned)_mm_cvtsi128_si32(v_s2);
+    }
+#endif
+    s1 %= 65521u;
+    s2 %= 65521u;
+  }
+
+  return (s2 << 16u) | s1;
+}
+#endif /*__AVX2__ || __SSSE3__*/
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+  unsigned s1, s2;
+#if defined(__AVX2__) || defined(__SSSE3__)
+  if(len >= 32u) {
+    adler = update_adler32_simd(adler, data, len & ~31u);
+    data += len & ~31u;
+    len &= 31u;
+  }
+#endif
+  s1 = adler & 0xffffu;
+  s2 = (adler >> 16u) & 0xffffu;
 
   while(len != 0u) {
     unsigned i;
     /*at least 5552 sums can be done before the sums overflow, saving a lot of module divisions*/
     unsigned amount = len > 5552u ? 5552u : len;
     len -= amount;
-    for(i = 0; i != amount; ++i) {
+    /*unrolled 16 bytes at a time with fixed offsets, 5552 is a multiple of 16*/
+    for(i = amount >> 4u; i != 0u; --i) {
+      s1 += data[0]; s2 += s1; s1 += data[1]; s2 += s1;
+      s1 += data[2]; s2 += s1; s1 += data[3]; s2 += s1;
+      s1 += data[4]; s2 += s1; s1 += data[5]; s2 += s1;
+      s1 += data[6]; s2 += s1; s1 += data[7]; s2 += s1;
+      s1 += data[8]; s2 += s1; s1 += data[9]; s2 += s1;
+      s1 += data[10]; s2 += s1; s1 += data[11]; s2 += s1;
+      s1 += data[12]; s2 += s1; s1 += data[13]; s2 += s1;
+      s1 += data[14]; s2 += s1; s1 += data[15]; s2 += s1;
+      data += 16;
+    }
+    for(i = amount & 15u; i != 0u; --i) {
       s1 += (*data++);
       s2 += s1;
     }
@@ -2332,13 +2563,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->hashbits = 0;
+  settings->maxchainlength = 16;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 16, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -356,6 +356,12 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned minmatch; /*minimum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*compact LZ77 matcher for memory constrained targets (gb-printer addition, not in upstream LodePNG).
+  If non-zero, matches are found with a 4-byte hash table of 2^hashbits 16-bit heads (max 16) and 16-bit
+  chain links over the window, instead of the 65536-entry hash table, and lazymatching is ignored.
+  Memory use is 2 * (2^hashbits + windowsize) bytes. Default: 0*/
+  unsigned hashbits;
+  unsigned maxchainlength; /*compact matcher only: max hash chain links followed per position. Default: 16*/
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -1,3 +1,6 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "benchmark.h"
 #include "common.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -28,6 +31,23 @@ static void core1_task(UNUSED void* arg) {
     }
 }
 
+#if CONFIG_PRINTER_BENCHMARK_AT_BOOT
+static void benchmark_task(UNUSED void* arg) {
+    ESP_ERROR_CHECK(printer_init());
+
+    const size_t kResultsSize = 6 * 1024;
+    char* results = malloc(kResultsSize);
+    ESP_ERROR_CHECK(results != NULL ? ESP_OK : ESP_ERR_NO_MEM);
+    esp_err_t result = benchmark_run(results, kResultsSize);
+    ESP_LOGI(TAG, "Benchmark finished: %s", esp_err_to_name(result));
+
+    // Results are printed as a single line, to be picked up from console output.
+    printf("BENCHMARK %s\n", results);
+    free(results);
+    vTaskDelete(NULL);
+}
+#endif
+
 void app_main(void) {
     ESP_LOGI(TAG, "GB PRINTER EMULATOR");
 
@@ -43,6 +63,12 @@ void app_main(void) {
     }
     ESP_ERROR_CHECK(res);
 
+#if CONFIG_PRINTER_BENCHMARK_AT_BOOT
+    // Benchmark only - Wi-Fi is not started, so this also runs under QEMU.
+    xTaskCreatePinnedToCore(benchmark_task, "benchmark_task", 8 * 1024, NULL, 5, NULL, 1);
+    return;
+#endif
+
     // Initialize components.
     // TODO: optimize stack sizes.
     // Run Wi-Fi and web server on task assigned to core 0.
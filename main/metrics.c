@@ -0,0 +1,179 @@
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "pipeline_heap.h"
+
+uint32_t metrics_counters[METRICS_NUM_COUNTERS] = {0};
+MetricsHistogramData metrics_histograms[METRICS_NUM_HISTOGRAMS] = {0};
+portMUX_TYPE metrics_histogram_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief Metric name and description.
+typedef struct {
+    const char* name;
+    const char* help;
+} MetricInfo;
+
+static const MetricInfo counter_info[METRICS_NUM_COUNTERS] = {
+    [METRICS_RX_BYTES] = {"gbprinter_rx_bytes_total", "Bytes received over link."},
+    [METRICS_RX_PACKETS] = {"gbprinter_rx_packets_total", "Packets received over link."},
+    [METRICS_CHECKSUM_ERRORS] = {"gbprinter_checksum_errors_total",
+                                 "Packets with invalid checksum."},
+    [METRICS_PACKET_ERRORS] = {"gbprinter_packet_errors_total",
+                               "Packets with invalid command or length."},
+    [METRICS_IMAGE_PARTS] = {"gbprinter_image_parts_total", "Image parts added to image builder."},
+    [METRICS_IMAGES] = {"gbprinter_images_total", "Encoded PNG images."},
+    [METRICS_HTTP_REQUESTS] = {"gbprinter_http_requests_total", "HTTP requests served."},
+    [METRICS_ALLOC_FAILURES] = {"gbprinter_alloc_failures_total",
+                                "Failed image pipeline allocations."},
+    [METRICS_IMAGE_PARTS_REJECTED] = {"gbprinter_image_parts_rejected_total",
+                                      "Image parts refused to stay within heap budget."},
+    [METRICS_JOBS_DEGRADED] = {"gbprinter_jobs_degraded_total",
+                               "Images created from fewer parts due to lack of free heap."},
+    [METRICS_JOBS_REJECTED] = {"gbprinter_jobs_rejected_total",
+                               "Images not created due to lack of free heap."},
+    [METRICS_ARENA_OVERFLOWS] = {"gbprinter_arena_overflows_total",
+                                 "Image pipeline allocations not fitting job arena."},
+    [METRICS_DUPLICATE_TILES] = {"gbprinter_duplicate_tiles_total",
+                                 "Stored tiles found in tile dictionary, not stored again."},
+    [METRICS_DUPLICATE_PARTS] = {"gbprinter_duplicate_parts_total",
+                                 "Image parts identical to a stored part, not stored again."},
+    [METRICS_DUPLICATE_JOBS] = {"gbprinter_duplicate_jobs_total",
+                                "Jobs identical to published image, not processed again."},
+    [METRICS_DEDUP_SAVED_BYTES] = {"gbprinter_dedup_saved_bytes_total",
+                                   "Image data bytes of duplicate parts and jobs."},
+    [METRICS_RX_OVERRUNS] = {"gbprinter_rx_overruns_total",
+                             "Received image data bytes dropped - no free receive buffer."},
+};
+
+static const MetricInfo histogram_info[METRICS_NUM_HISTOGRAMS] = {
+    [METRICS_ISR_DURATION_CYCLES] = {"gbprinter_isr_duration_cycles",
+                                     "Clock ISR duration in CPU cycles."},
+    [METRICS_ENCODE_DURATION_US] = {"gbprinter_encode_duration_microseconds",
+                                    "PNG encoding duration in microseconds."},
+    [METRICS_PNG_SIZE_BYTES] = {"gbprinter_png_size_bytes", "Encoded PNG size in bytes."},
+    [METRICS_JOB_PEAK_HEAP_BYTES] = {"gbprinter_job_peak_heap_bytes",
+                                     "Peak heap usage of image pipeline per job in bytes."},
+};
+
+/// @brief Output buffer state.
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t length;
+} Output;
+
+static void append(Output* output, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const size_t offset = output->length < output->size ? output->length : output->size;
+    const int written = vsnprintf(output->buffer + offset, output->size - offset, format, args);
+    va_end(args);
+    if (written > 0) {
+        output->length += written;
+    }
+}
+
+static void append_gauge(Output* output, const char* name, const char* help, size_t value) {
+    append(output, "# HELP %s %s\n# TYPE %s gauge\n%s %u\n", name, help, name, name, value);
+}
+
+size_t metrics_format(char* buffer, size_t size) {
+    Output output = {.buffer = buffer, .size = size, .length = 0};
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+
+    // Counters.
+    for (int i = 0; i < METRICS_NUM_COUNTERS; ++i) {
+        const MetricInfo* info = &counter_info[i];
+        const uint32_t value = __atomic_load_n(&metrics_counters[i], __ATOMIC_RELAXED);
+        append(&output, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", info->name, info->help,
+               info->name, info->name, value);
+    }
+
+    // Histograms.
+    for (int i = 0; i < METRICS_NUM_HISTOGRAMS; ++i) {
+        const MetricInfo* info = &histogram_info[i];
+        // Copy is consistent - count matches buckets and sum.
+        MetricsHistogramData data;
+        portENTER_CRITICAL(&metrics_histogram_lock);
+        memcpy(&data, &metrics_histograms[i], sizeof(MetricsHistogramData));
+        portEXIT_CRITICAL(&metrics_histogram_lock);
+        append(&output, "# HELP %s %s\n# TYPE %s histogram\n", info->name, info->help, info->name);
+        // Last bucket is only reported as '+Inf'.
+        uint32_t cumulative = 0;
+        for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS - 1; ++b) {
+            cumulative += data.buckets[b];
+            append(&output, "%s_bucket{le=\"%lu\"} %lu\n", info->name, 1UL << b, cumulative);
+        }
+        append(&output, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %llu\n%s_count %lu\n", info->name,
+               data.count, info->name, data.sum, info->name, data.count);
+    }
+
+    // Heap gauges are read on demand.
+    append_gauge(&output, "gbprinter_heap_free_bytes", "Free heap size.",
+                 heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    append_gauge(&output, "gbprinter_heap_min_free_bytes", "Minimum free heap size since boot.",
+                 heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    append_gauge(&output, "gbprinter_heap_largest_free_block_bytes", "Largest free heap block.",
+                 heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+
+    // Image pipeline heap usage per stage.
+    size_t current[PIPELINE_NUM_STAGES];
+    size_t job_peak[PIPELINE_NUM_STAGES];
+    for (int i = 0; i < PIPELINE_NUM_STAGES; ++i) {
+        pipeline_heap_stats(i, &current[i], &job_peak[i]);
+    }
+    append(&output,
+           "# HELP gbprinter_pipeline_heap_bytes Heap used by image pipeline stage.\n"
+           "# TYPE gbprinter_pipeline_heap_bytes gauge\n");
+    for (int i = 0; i < PIPELINE_NUM_STAGES; ++i) {
+        append(&output, "gbprinter_pipeline_heap_bytes{stage=\"%s\"} %u\n",
+               pipeline_stage_name(i), current[i]);
+    }
+    append(&output,
+           "# HELP gbprinter_pipeline_job_peak_heap_bytes "
+           "Peak heap used by image pipeline stage during last job.\n"
+           "# TYPE gbprinter_pipeline_job_peak_heap_bytes gauge\n");
+    for (int i = 0; i < PIPELINE_NUM_STAGES; ++i) {
+        append(&output, "gbprinter_pipeline_job_peak_heap_bytes{stage=\"%s\"} %u\n",
+               pipeline_stage_name(i), job_peak[i]);
+    }
+
+    // Job arena.
+    size_t arena_size;
+    size_t arena_peak;
+    pipeline_arena_stats(&arena_size, &arena_peak);
+    append(&output,
+           "# HELP gbprinter_pipeline_arena_bytes Size of image pipeline job arena.\n"
+           "# TYPE gbprinter_pipeline_arena_bytes gauge\n"
+           "gbprinter_pipeline_arena_bytes %u\n"
+           "# HELP gbprinter_pipeline_arena_job_peak_bytes "
+           "Peak job arena usage during last job.\n"
+           "# TYPE gbprinter_pipeline_arena_job_peak_bytes gauge\n"
+           "gbprinter_pipeline_arena_job_peak_bytes %u\n",
+           arena_size, arena_peak);
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_RUN_TIME_COUNTER_SOURCE_ESP_TIMER
+    // CPU usage of a core is derived from increase of its idle time over increase of uptime.
+    // Idle time wraps around with 32-bit run time counters.
+    append(&output,
+           "# HELP gbprinter_idle_time_microseconds_total Time spent by idle task of core.\n"
+           "# TYPE gbprinter_idle_time_microseconds_total counter\n");
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; ++core) {
+        append(&output, "gbprinter_idle_time_microseconds_total{core=\"%d\"} %llu\n", core,
+               (unsigned long long)ulTaskGetIdleRunTimeCounterForCore(core));
+    }
+    append(&output,
+           "# HELP gbprinter_uptime_microseconds Time since boot.\n"
+           "# TYPE gbprinter_uptime_microseconds counter\n"
+           "gbprinter_uptime_microseconds %lld\n",
+           esp_timer_get_time());
+#endif
+
+    return output.length;
+}
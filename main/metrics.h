@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+
+/// @brief Counters.
+///        Can be incremented from any task and from ISR.
+enum MetricsCounter {
+    /// @brief Bytes received over link.
+    METRICS_RX_BYTES,
+    /// @brief Packets received over link.
+    METRICS_RX_PACKETS,
+    /// @brief Packets with invalid checksum.
+    METRICS_CHECKSUM_ERRORS,
+    /// @brief Packets with invalid command or length.
+    METRICS_PACKET_ERRORS,
+    /// @brief Image parts added to image builder.
+    METRICS_IMAGE_PARTS,
+    /// @brief Encoded PNG images.
+    METRICS_IMAGES,
+    /// @brief HTTP requests served.
+    METRICS_HTTP_REQUESTS,
+    /// @brief Failed image pipeline allocations.
+    METRICS_ALLOC_FAILURES,
+    /// @brief Image parts refused to stay within heap budget.
+    METRICS_IMAGE_PARTS_REJECTED,
+    /// @brief Images created from fewer parts due to lack of free heap.
+    METRICS_JOBS_DEGRADED,
+    /// @brief Images not created due to lack of free heap.
+    METRICS_JOBS_REJECTED,
+    /// @brief Image pipeline allocations not fitting job arena.
+    METRICS_ARENA_OVERFLOWS,
+    /// @brief Stored tiles found in tile dictionary, not stored again.
+    METRICS_DUPLICATE_TILES,
+    /// @brief Image parts identical to a stored part, not stored again.
+    METRICS_DUPLICATE_PARTS,
+    /// @brief Jobs identical to published image, not processed again.
+    METRICS_DUPLICATE_JOBS,
+    /// @brief Image data bytes of duplicate parts and jobs.
+    METRICS_DEDUP_SAVED_BYTES,
+    /// @brief Received image data bytes dropped - no free receive buffer.
+    METRICS_RX_OVERRUNS,
+    METRICS_NUM_COUNTERS
+};
+
+/// @brief Histograms.
+///        Can be observed from any task and from ISR.
+enum MetricsHistogram {
+    /// @brief Clock ISR duration in CPU cycles.
+    METRICS_ISR_DURATION_CYCLES,
+    /// @brief PNG encoding duration in microseconds.
+    METRICS_ENCODE_DURATION_US,
+    /// @brief Encoded PNG size in bytes.
+    METRICS_PNG_SIZE_BYTES,
+    /// @brief Peak heap usage of image pipeline per job in bytes.
+    METRICS_JOB_PEAK_HEAP_BYTES,
+    METRICS_NUM_HISTOGRAMS
+};
+
+/// Number of histogram buckets.
+/// Bucket 'i' counts values in range (2^(i-1), 2^i], last bucket counts remaining values.
+#define METRICS_HISTOGRAM_BUCKETS 26
+
+/// @brief Histogram data.
+typedef struct {
+    uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint64_t sum;
+} MetricsHistogramData;
+
+// Storage used by inline functions below. Do not use directly.
+extern uint32_t metrics_counters[METRICS_NUM_COUNTERS];
+extern MetricsHistogramData metrics_histograms[METRICS_NUM_HISTOGRAMS];
+// Protects histograms - each is a few words updated together, read from another core.
+extern portMUX_TYPE metrics_histogram_lock;
+
+/// @brief          Increase counter by one.
+/// @param counter  Counter to increase.
+FORCE_INLINE_ATTR void metrics_inc(enum MetricsCounter counter) {
+    __atomic_fetch_add(&metrics_counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+/// @brief          Increase counter.
+/// @param counter  Counter to increase.
+/// @param value    Value to add.
+FORCE_INLINE_ATTR void metrics_add(enum MetricsCounter counter, uint32_t value) {
+    __atomic_fetch_add(&metrics_counters[counter], value, __ATOMIC_RELAXED);
+}
+
+/// @brief              Add value to histogram.
+/// @param histogram    Histogram to update.
+/// @param value        Observed value.
+FORCE_INLINE_ATTR void metrics_observe(enum MetricsHistogram histogram, uint32_t value) {
+    MetricsHistogramData* data = &metrics_histograms[histogram];
+    uint32_t bucket = value <= 1 ? 0 : 32 - __builtin_clz(value - 1);
+    if (bucket >= METRICS_HISTOGRAM_BUCKETS) {
+        bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    portENTER_CRITICAL_SAFE(&metrics_histogram_lock);
+    ++data->buckets[bucket];
+    ++data->count;
+    data->sum += value;
+    portEXIT_CRITICAL_SAFE(&metrics_histogram_lock);
+}
+
+/// @brief          Write all metrics in Prometheus text exposition format.
+/// @param buffer   Output buffer. Output is always null-terminated.
+/// @param size     Size of output buffer.
+/// @return         Length of the output, excluding null terminator.
+///                 Output is truncated if greater or equal to 'size'.
+size_t metrics_format(char* buffer, size_t size);
@@ -0,0 +1,344 @@
+#include "pipeline_heap.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "sdkconfig.h"
+
+static const char* TAG = "PIPELINE_HEAP";
+
+#define HEAP_BUDGET (CONFIG_PRINTER_HEAP_BUDGET_KB * 1024)
+#define ARENA_SIZE  (CONFIG_PRINTER_PIPELINE_ARENA_KB * 1024)
+
+/// @brief Allocation header, placed in front of returned memory.
+typedef struct {
+    uint32_t size;
+    uint32_t stage;
+} AllocHeader;
+
+static const char* stage_names[PIPELINE_NUM_STAGES] = {
+    [PIPELINE_STAGE_PARTS] = "parts",
+    [PIPELINE_STAGE_BITMAP] = "bitmap",
+    [PIPELINE_STAGE_ENCODE] = "encode",
+    [PIPELINE_STAGE_IMAGE] = "image",
+};
+
+// Protects usage below - memory is allocated and freed by printer, timer and server tasks.
+static portMUX_TYPE heap_lock = portMUX_INITIALIZER_UNLOCKED;
+// Bytes currently allocated.
+static size_t stage_bytes[PIPELINE_NUM_STAGES] = {0};
+static size_t total_bytes = 0;
+// Peak bytes allocated during current job.
+static size_t stage_peak[PIPELINE_NUM_STAGES] = {0};
+static size_t total_peak = 0;
+// Peak bytes allocated during last finished job.
+static size_t last_stage_peak[PIPELINE_NUM_STAGES] = {0};
+
+// Job arena - allocated with the first job and kept, so encoder buffers never fragment heap.
+// Set once, by the first task using it.
+static uint8_t* _Atomic arena = NULL;
+// Arena serves bitmap and encoder allocations.
+static bool arena_active = false;
+// Task which began the job, only its allocations are served from arena. Memory of other tasks
+// must not be released by arena reset of this one.
+static TaskHandle_t arena_owner = NULL;
+// Offset of first free byte.
+static size_t arena_offset = 0;
+// Offset of the last allocation - only this one can grow in place.
+static size_t arena_last = 0;
+// Highest offset reached during current and last finished job.
+static size_t arena_peak = 0;
+static size_t last_arena_peak = 0;
+
+static void account_alloc(uint32_t stage, size_t size) {
+    portENTER_CRITICAL(&heap_lock);
+    stage_bytes[stage] += size;
+    total_bytes += size;
+    if (stage_bytes[stage] > stage_peak[stage]) {
+        stage_peak[stage] = stage_bytes[stage];
+    }
+    if (total_bytes > total_peak) {
+        total_peak = total_bytes;
+    }
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+static void account_free(uint32_t stage, size_t size) {
+    portENTER_CRITICAL(&heap_lock);
+    stage_bytes[stage] -= size;
+    total_bytes -= size;
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+static void report_failure(enum PipelineStage stage, size_t size) {
+    metrics_inc(METRICS_ALLOC_FAILURES);
+    ESP_LOGW(TAG, "Failed to allocate %u bytes for %s", size, stage_names[stage]);
+}
+
+static bool in_arena(const AllocHeader* header) {
+    return arena != NULL && (const uint8_t*)header >= arena &&
+           (const uint8_t*)header < arena + ARENA_SIZE;
+}
+
+/// @brief Check if arena is active for calling task. Must be called with lock held.
+static bool arena_owned(void) {
+    return arena_active && arena_owner == xTaskGetCurrentTaskHandle();
+}
+
+/// @brief  Allocate from arena by bumping offset.
+/// @return Allocated memory, NULL if arena is not active for calling task, not used for stage
+///         or full.
+static AllocHeader* arena_alloc(enum PipelineStage stage, size_t size) {
+    if (stage != PIPELINE_STAGE_BITMAP && stage != PIPELINE_STAGE_ENCODE) {
+        return NULL;
+    }
+
+    // Keep headers aligned.
+    size = (size + sizeof(AllocHeader) - 1) & ~(sizeof(AllocHeader) - 1);
+    AllocHeader* header = NULL;
+    portENTER_CRITICAL(&heap_lock);
+    const bool owned = arena_owned();
+    if (owned && size <= ARENA_SIZE - arena_offset) {
+        header = (AllocHeader*)(arena + arena_offset);
+        arena_last = arena_offset;
+        arena_offset += size;
+        if (arena_offset > arena_peak) {
+            arena_peak = arena_offset;
+        }
+    }
+    portEXIT_CRITICAL(&heap_lock);
+
+    if (owned && header == NULL) {
+        metrics_inc(METRICS_ARENA_OVERFLOWS);
+    }
+    return header;
+}
+
+/// @brief  Resize last arena allocation in place.
+/// @return True if resized.
+static bool arena_resize(AllocHeader* header, size_t size) {
+    const size_t offset = (uint8_t*)header - arena;
+    size = (size + sizeof(AllocHeader) - 1) & ~(sizeof(AllocHeader) - 1);
+    bool resized = false;
+    portENTER_CRITICAL(&heap_lock);
+    if (arena_owned() && offset == arena_last && size <= ARENA_SIZE - offset) {
+        arena_offset = offset + size;
+        if (arena_offset > arena_peak) {
+            arena_peak = arena_offset;
+        }
+        resized = true;
+    }
+    portEXIT_CRITICAL(&heap_lock);
+    return resized;
+}
+
+/// @brief Release arena allocation. Only the last one is reclaimed, others wait for reset.
+static void arena_free(AllocHeader* header) {
+    const size_t offset = (uint8_t*)header - arena;
+    portENTER_CRITICAL(&heap_lock);
+    if (offset == arena_last) {
+        arena_offset = offset;
+    }
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+void* pipeline_malloc(enum PipelineStage stage, size_t size) {
+    AllocHeader* header = arena_alloc(stage, sizeof(AllocHeader) + size);
+    if (header == NULL) {
+        header = malloc(sizeof(AllocHeader) + size);
+    }
+    if (header == NULL) {
+        report_failure(stage, size);
+        return NULL;
+    }
+
+    header->size = size;
+    header->stage = stage;
+    account_alloc(stage, size);
+    return header + 1;
+}
+
+void* pipeline_calloc(enum PipelineStage stage, size_t size) {
+    void* ptr = pipeline_malloc(stage, size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void* pipeline_realloc(enum PipelineStage stage, void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return pipeline_malloc(stage, size);
+    }
+
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    const uint32_t old_size = header->size;
+    const uint32_t old_stage = header->stage;
+    if (in_arena(header)) {
+        if (arena_resize(header, sizeof(AllocHeader) + size)) {
+            account_free(old_stage, old_size);
+            header->size = size;
+            header->stage = stage;
+            account_alloc(stage, size);
+            return ptr;
+        }
+
+        // Move elsewhere - old memory is reclaimed by arena reset.
+        void* new_ptr = pipeline_malloc(stage, size);
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+            pipeline_free(ptr);
+        }
+        return new_ptr;
+    }
+
+    AllocHeader* new_header = realloc(header, sizeof(AllocHeader) + size);
+    if (new_header == NULL) {
+        report_failure(stage, size);
+        return NULL;
+    }
+
+    account_free(old_stage, old_size);
+    new_header->size = size;
+    new_header->stage = stage;
+    account_alloc(stage, size);
+    return new_header + 1;
+}
+
+void pipeline_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    account_free(header->stage, header->size);
+    if (in_arena(header)) {
+        arena_free(header);
+    } else {
+        free(header);
+    }
+}
+
+void* pipeline_persist(void* ptr, size_t size, enum PipelineStage stage) {
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    if (!in_arena(header)) {
+        // Shrink to size, heap keeps the tail.
+        return pipeline_realloc(stage, ptr, size);
+    }
+
+    void* new_ptr = NULL;
+    AllocHeader* new_header = malloc(sizeof(AllocHeader) + size);
+    if (new_header != NULL) {
+        new_header->size = size;
+        new_header->stage = stage;
+        account_alloc(stage, size);
+        new_ptr = new_header + 1;
+        memcpy(new_ptr, ptr, size);
+        pipeline_free(ptr);
+    } else {
+        report_failure(stage, size);
+    }
+    return new_ptr;
+}
+
+void pipeline_arena_begin(void) {
+    if (ARENA_SIZE == 0) {
+        return;
+    }
+
+    if (atomic_load(&arena) == NULL) {
+        uint8_t* new_arena = malloc(ARENA_SIZE);
+        if (new_arena == NULL) {
+            // Retried with next job.
+            ESP_LOGW(TAG, "Failed to allocate %u bytes arena, using heap", ARENA_SIZE);
+            return;
+        }
+        uint8_t* expected = NULL;
+        if (!atomic_compare_exchange_strong(&arena, &expected, new_arena)) {
+            free(new_arena);
+        }
+    }
+
+    // Arena in use by another task stays with it, this job uses heap only.
+    portENTER_CRITICAL(&heap_lock);
+    const bool taken = arena_active;
+    if (!taken) {
+        arena_offset = 0;
+        arena_last = 0;
+        arena_peak = 0;
+        arena_active = true;
+        arena_owner = xTaskGetCurrentTaskHandle();
+    }
+    portEXIT_CRITICAL(&heap_lock);
+    if (taken) {
+        ESP_LOGW(TAG, "Arena is used by another task, using heap");
+    }
+}
+
+void pipeline_arena_reset(void) {
+    portENTER_CRITICAL(&heap_lock);
+    if (arena_owned()) {
+        arena_active = false;
+        arena_owner = NULL;
+        arena_offset = 0;
+        arena_last = 0;
+        last_arena_peak = arena_peak;
+    }
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+size_t pipeline_arena_available(void) {
+    portENTER_CRITICAL(&heap_lock);
+    const size_t available = arena_owned() ? ARENA_SIZE - arena_offset : 0;
+    portEXIT_CRITICAL(&heap_lock);
+    return available;
+}
+
+void pipeline_heap_job_begin(void) {
+    portENTER_CRITICAL(&heap_lock);
+    memcpy(stage_peak, stage_bytes, sizeof(stage_peak));
+    total_peak = total_bytes;
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+void pipeline_heap_job_end(void) {
+    portENTER_CRITICAL(&heap_lock);
+    memcpy(last_stage_peak, stage_peak, sizeof(last_stage_peak));
+    const size_t peak = total_peak;
+    portEXIT_CRITICAL(&heap_lock);
+
+    metrics_observe(METRICS_JOB_PEAK_HEAP_BYTES, peak);
+    ESP_LOGD(TAG, "Job peak heap usage: %u bytes", peak);
+}
+
+bool pipeline_heap_admit(size_t bytes) { return bytes <= HEAP_BUDGET; }
+
+const char* pipeline_stage_name(enum PipelineStage stage) { return stage_names[stage]; }
+
+void pipeline_heap_stats(enum PipelineStage stage, size_t* current, size_t* job_peak) {
+    portENTER_CRITICAL(&heap_lock);
+    *current = stage_bytes[stage];
+    *job_peak = last_stage_peak[stage];
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+void pipeline_arena_stats(size_t* size, size_t* job_peak) {
+    portENTER_CRITICAL(&heap_lock);
+    *size = arena != NULL ? ARENA_SIZE : 0;
+    *job_peak = last_arena_peak;
+    portEXIT_CRITICAL(&heap_lock);
+}
+
+// LodePNG allocators, used with 'LODEPNG_NO_COMPILE_ALLOCATORS'.
+
+void* lodepng_malloc(size_t size) { return pipeline_malloc(PIPELINE_STAGE_ENCODE, size); }
+
+void* lodepng_realloc(void* ptr, size_t new_size) {
+    return pipeline_realloc(PIPELINE_STAGE_ENCODE, ptr, new_size);
+}
+
+void lodepng_free(void* ptr) { pipeline_free(ptr); }
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// @brief Image pipeline stages. Each allocation is accounted to a single stage.
+enum PipelineStage {
+    /// @brief Image parts stored by image builder.
+    PIPELINE_STAGE_PARTS,
+    /// @brief Bitmap built from image parts.
+    PIPELINE_STAGE_BITMAP,
+    /// @brief PNG encoder buffers.
+    PIPELINE_STAGE_ENCODE,
+    /// @brief Published PNG image.
+    PIPELINE_STAGE_IMAGE,
+    PIPELINE_NUM_STAGES
+};
+
+/// @brief          Allocate memory accounted to pipeline stage.
+/// @param stage    Pipeline stage.
+/// @param size     Size in bytes.
+/// @return         Allocated memory, NULL on failure.
+void* pipeline_malloc(enum PipelineStage stage, size_t size);
+
+/// @brief          Allocate zero-initialized memory accounted to pipeline stage.
+/// @param stage    Pipeline stage.
+/// @param size     Size in bytes.
+/// @return         Allocated memory, NULL on failure.
+void* pipeline_calloc(enum PipelineStage stage, size_t size);
+
+/// @brief          Resize memory allocated with pipeline allocator.
+/// @param stage    Pipeline stage. Memory is accounted to this stage afterwards.
+/// @param ptr      Memory to resize. NULL to allocate.
+/// @param size     New size in bytes.
+/// @return         Resized memory, NULL on failure - original memory is left untouched.
+void* pipeline_realloc(enum PipelineStage stage, void* ptr, size_t size);
+
+/// @brief      Free memory allocated with pipeline allocator.
+/// @param ptr  Memory to free. NULL is ignored.
+void pipeline_free(void* ptr);
+
+/// @brief          Keep memory beyond current job, e.g., once encoder output is published.
+///                 Memory is moved out of job arena, or shrunk in place.
+/// @param ptr      Memory allocated with pipeline allocator.
+/// @param size     Number of bytes to keep.
+/// @param stage    New pipeline stage.
+/// @return         Kept memory, NULL on failure - original memory is left untouched.
+void* pipeline_persist(void* ptr, size_t size, enum PipelineStage stage);
+
+/// @brief  Serve bitmap and encoder allocations of calling task from job arena until
+///         'pipeline_arena_reset'. Arena is allocated on first use. Allocations not fitting arena
+///         fall back to heap, as do all allocations if another task is using the arena.
+void pipeline_arena_begin(void);
+
+/// @brief  Release all arena allocations at once. Arena memory itself is kept.
+///         Does nothing unless arena is used by calling task.
+void pipeline_arena_reset(void);
+
+/// @return Free bytes in arena used by calling task, 0 if it isn't using arena.
+size_t pipeline_arena_available(void);
+
+/// @brief  Start new job - peak usage is recorded from now on.
+void pipeline_heap_job_begin(void);
+
+/// @brief  End current job and report its peak usage to metrics.
+void pipeline_heap_job_end(void);
+
+/// @brief          Check if job fits into heap budget.
+/// @param bytes    Estimated peak usage of the job.
+/// @return         True if job can be admitted.
+bool pipeline_heap_admit(size_t bytes);
+
+/// @return Name of pipeline stage.
+const char* pipeline_stage_name(enum PipelineStage stage);
+
+/// @brief          Get usage of pipeline stage.
+/// @param stage    Pipeline stage.
+/// @param current  Output - bytes currently allocated.
+/// @param job_peak Output - peak bytes allocated during last finished job.
+void pipeline_heap_stats(enum PipelineStage stage, size_t* current, size_t* job_peak);
+
+/// @brief          Get usage of job arena.
+/// @param size     Output - arena size, 0 if not allocated.
+/// @param job_peak Output - peak bytes used during last finished job.
+void pipeline_arena_stats(size_t* size, size_t* job_peak);
@@ -0,0 +1,13 @@
+#include "esp_rom_crc.h"
+#include "lodepng.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PRINTER_PNG_ROM_CRC
+
+// CRC-32 of PNG chunks, used with 'LODEPNG_NO_COMPILE_CRC'.
+// ROM routine pre- and post-inverts CRC, as PNG does.
+unsigned lodepng_crc32(const unsigned char* data, size_t length) {
+    return esp_rom_crc32_le(0, data, length);
+}
+
+#endif
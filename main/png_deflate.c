@@ -0,0 +1,231 @@
+#include "png_deflate.h"
+#include <stdint.h>
+#include <string.h>
+#include "pipeline_heap.h"
+
+// Allocation failure, as reported by LodePNG.
+#define ERROR_ALLOC 83
+
+#define MIN_MATCH       3
+#define MAX_MATCH       258
+#define DEFAULT_HASH_BITS 11
+#define END_OF_BLOCK    256
+#define NUM_LITERAL_CODES  288
+#define NUM_LENGTH_CODES   29
+#define NUM_DISTANCE_CODES 30
+
+static const uint16_t length_base[NUM_LENGTH_CODES] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[NUM_LENGTH_CODES] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distance_base[NUM_DISTANCE_CODES] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+
+// Fixed Huffman codes of RFC 1951, 3.2.6, bit-reversed for LSB-first output.
+// Constant, so encoders running on different tasks need no initialization.
+static const uint16_t fixed_literal_codes[NUM_LITERAL_CODES] = {
+    0x00C, 0x08C, 0x04C, 0x0CC, 0x02C, 0x0AC, 0x06C, 0x0EC, 0x01C, 0x09C, 0x05C, 0x0DC,
+    0x03C, 0x0BC, 0x07C, 0x0FC, 0x002, 0x082, 0x042, 0x0C2, 0x022, 0x0A2, 0x062, 0x0E2,
+    0x012, 0x092, 0x052, 0x0D2, 0x032, 0x0B2, 0x072, 0x0F2, 0x00A, 0x08A, 0x04A, 0x0CA,
+    0x02A, 0x0AA, 0x06A, 0x0EA, 0x01A, 0x09A, 0x05A, 0x0DA, 0x03A, 0x0BA, 0x07A, 0x0FA,
+    0x006, 0x086, 0x046, 0x0C6, 0x026, 0x0A6, 0x066, 0x0E6, 0x016, 0x096, 0x056, 0x0D6,
+    0x036, 0x0B6, 0x076, 0x0F6, 0x00E, 0x08E, 0x04E, 0x0CE, 0x02E, 0x0AE, 0x06E, 0x0EE,
+    0x01E, 0x09E, 0x05E, 0x0DE, 0x03E, 0x0BE, 0x07E, 0x0FE, 0x001, 0x081, 0x041, 0x0C1,
+    0x021, 0x0A1, 0x061, 0x0E1, 0x011, 0x091, 0x051, 0x0D1, 0x031, 0x0B1, 0x071, 0x0F1,
+    0x009, 0x089, 0x049, 0x0C9, 0x029, 0x0A9, 0x069, 0x0E9, 0x019, 0x099, 0x059, 0x0D9,
+    0x039, 0x0B9, 0x079, 0x0F9, 0x005, 0x085, 0x045, 0x0C5, 0x025, 0x0A5, 0x065, 0x0E5,
+    0x015, 0x095, 0x055, 0x0D5, 0x035, 0x0B5, 0x075, 0x0F5, 0x00D, 0x08D, 0x04D, 0x0CD,
+    0x02D, 0x0AD, 0x06D, 0x0ED, 0x01D, 0x09D, 0x05D, 0x0DD, 0x03D, 0x0BD, 0x07D, 0x0FD,
+    0x013, 0x113, 0x093, 0x193, 0x053, 0x153, 0x0D3, 0x1D3, 0x033, 0x133, 0x0B3, 0x1B3,
+    0x073, 0x173, 0x0F3, 0x1F3, 0x00B, 0x10B, 0x08B, 0x18B, 0x04B, 0x14B, 0x0CB, 0x1CB,
+    0x02B, 0x12B, 0x0AB, 0x1AB, 0x06B, 0x16B, 0x0EB, 0x1EB, 0x01B, 0x11B, 0x09B, 0x19B,
+    0x05B, 0x15B, 0x0DB, 0x1DB, 0x03B, 0x13B, 0x0BB, 0x1BB, 0x07B, 0x17B, 0x0FB, 0x1FB,
+    0x007, 0x107, 0x087, 0x187, 0x047, 0x147, 0x0C7, 0x1C7, 0x027, 0x127, 0x0A7, 0x1A7,
+    0x067, 0x167, 0x0E7, 0x1E7, 0x017, 0x117, 0x097, 0x197, 0x057, 0x157, 0x0D7, 0x1D7,
+    0x037, 0x137, 0x0B7, 0x1B7, 0x077, 0x177, 0x0F7, 0x1F7, 0x00F, 0x10F, 0x08F, 0x18F,
+    0x04F, 0x14F, 0x0CF, 0x1CF, 0x02F, 0x12F, 0x0AF, 0x1AF, 0x06F, 0x16F, 0x0EF, 0x1EF,
+    0x01F, 0x11F, 0x09F, 0x19F, 0x05F, 0x15F, 0x0DF, 0x1DF, 0x03F, 0x13F, 0x0BF, 0x1BF,
+    0x07F, 0x17F, 0x0FF, 0x1FF, 0x000, 0x040, 0x020, 0x060, 0x010, 0x050, 0x030, 0x070,
+    0x008, 0x048, 0x028, 0x068, 0x018, 0x058, 0x038, 0x078, 0x004, 0x044, 0x024, 0x064,
+    0x014, 0x054, 0x034, 0x074, 0x003, 0x083, 0x043, 0x0C3, 0x023, 0x0A3, 0x063, 0x0E3};
+static const uint8_t fixed_literal_bits[NUM_LITERAL_CODES] = {
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8};
+static const uint8_t fixed_distance_codes[NUM_DISTANCE_CODES] = {
+    0x00, 0x10, 0x08, 0x18, 0x04, 0x14, 0x0C, 0x1C, 0x02, 0x12, 0x0A, 0x1A, 0x06, 0x16, 0x0E,
+    0x1E, 0x01, 0x11, 0x09, 0x19, 0x05, 0x15, 0x0D, 0x1D, 0x03, 0x13, 0x0B, 0x1B, 0x07, 0x17};
+// Length code of each match length, indexed by length - MIN_MATCH. Length 258 has its own code,
+// although previous one could represent it.
+static const uint8_t length_codes[MAX_MATCH - MIN_MATCH + 1] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13,
+    14, 14, 14, 14, 15, 15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17,
+    18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20,
+    20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+    23, 23, 23, 23, 23, 23, 23, 23, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+    24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25,
+    25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+    26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+    26, 26, 26, 26, 26, 26, 26, 26, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+    27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28};
+
+/// @brief Output bit stream. Output buffer is sized for worst case upfront.
+typedef struct {
+    uint8_t* data;
+    size_t length;
+    uint32_t bits;
+    uint32_t num_bits;
+} BitWriter;
+
+static inline void write_bits(BitWriter* writer, uint32_t value, uint32_t count) {
+    writer->bits |= value << writer->num_bits;
+    writer->num_bits += count;
+    while (writer->num_bits >= 8) {
+        writer->data[writer->length++] = writer->bits;
+        writer->bits >>= 8;
+        writer->num_bits -= 8;
+    }
+}
+
+static inline void write_literal(BitWriter* writer, uint32_t symbol) {
+    write_bits(writer, fixed_literal_codes[symbol], fixed_literal_bits[symbol]);
+}
+
+static void write_match(BitWriter* writer, uint32_t length, uint32_t distance) {
+    const uint32_t length_code = length_codes[length - MIN_MATCH];
+    write_literal(writer, 257 + length_code);
+    write_bits(writer, length - length_base[length_code], length_extra[length_code]);
+
+    // Distance codes come in pairs sharing the number of extra bits.
+    const uint32_t d = distance - 1;
+    uint32_t distance_code = d;
+    uint32_t extra_bits = 0;
+    if (d >= 4) {
+        const uint32_t msb = 31 - __builtin_clz(d);
+        distance_code = msb * 2 + ((d >> (msb - 1)) & 1);
+        extra_bits = msb - 1;
+    }
+    write_bits(writer, fixed_distance_codes[distance_code], 5);
+    write_bits(writer, distance - distance_base[distance_code], extra_bits);
+}
+
+static inline uint32_t hash4(const uint8_t* data, uint32_t hash_bits) {
+    const uint32_t value = data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+    return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+unsigned png_deflate_fixed(unsigned char** out, size_t* outsize, const unsigned char* in,
+                           size_t insize, const LodePNGCompressSettings* settings) {
+    const uint32_t window_size = settings->windowsize;
+    if (window_size == 0 || window_size > 32768 || (window_size & (window_size - 1)) != 0) {
+        return 60;
+    }
+    const uint32_t hash_bits = settings->hashbits > 0 && settings->hashbits <= 16
+                                   ? settings->hashbits
+                                   : DEFAULT_HASH_BITS;
+    const uint32_t max_chain = settings->maxchainlength > 0 ? settings->maxchainlength : 1;
+    const uint32_t nice_match = settings->nicematch < MAX_MATCH ? settings->nicematch : MAX_MATCH;
+
+    // Worst case is 9 bits per byte, plus block header and end of block code.
+    const size_t capacity = *outsize + insize + insize / 8 + 4;
+    uint8_t* data = pipeline_realloc(PIPELINE_STAGE_ENCODE, *out, capacity);
+    // Chain entries are window positions + 1, 0 marks no entry.
+    const size_t heads_size = sizeof(uint16_t) << hash_bits;
+    uint16_t* heads = pipeline_malloc(PIPELINE_STAGE_ENCODE, heads_size);
+    uint16_t* chain = pipeline_malloc(PIPELINE_STAGE_ENCODE, sizeof(uint16_t) * window_size);
+    if (data == NULL || heads == NULL || chain == NULL) {
+        if (data != NULL) {
+            *out = data;
+        }
+        pipeline_free(heads);
+        pipeline_free(chain);
+        return ERROR_ALLOC;
+    }
+    *out = data;
+    memset(heads, 0, heads_size);
+    memset(chain, 0, sizeof(uint16_t) * window_size);
+
+    BitWriter writer = {.data = data, .length = *outsize, .bits = 0, .num_bits = 0};
+    // Final block, fixed Huffman codes.
+    write_bits(&writer, 1, 1);
+    write_bits(&writer, 1, 2);
+
+    size_t pos = 0;
+    while (pos < insize) {
+        uint32_t length = 0;
+        uint32_t distance = 0;
+        if (pos + 4 <= insize) {
+            const size_t max_length = insize - pos < MAX_MATCH ? insize - pos : MAX_MATCH;
+            const uint32_t window_pos = pos & (window_size - 1);
+            const uint32_t hash = hash4(&in[pos], hash_bits);
+            uint32_t next = heads[hash];
+            uint32_t previous_distance = 0;
+            for (uint32_t links = 0; next != 0 && links < max_chain; ++links) {
+                const uint32_t candidate = next - 1;
+                const uint32_t candidate_distance = (window_pos - candidate) & (window_size - 1);
+                const uint32_t current_distance =
+                    candidate_distance == 0 ? window_size : candidate_distance;
+                // Distances grow along chain, unless window was overwritten since.
+                if (current_distance <= previous_distance || current_distance > pos) {
+                    break;
+                }
+                previous_distance = current_distance;
+
+                // Entries can be outdated, so bytes are always compared.
+                const uint8_t* back = &in[pos - current_distance];
+                const uint8_t* front = &in[pos];
+                const uint8_t* end = front + max_length;
+                while (front != end && *back == *front) {
+                    ++back;
+                    ++front;
+                }
+                const uint32_t current_length = front - &in[pos];
+                if (current_length > length) {
+                    length = current_length;
+                    distance = current_distance;
+                    if (length >= nice_match) {
+                        break;
+                    }
+                }
+                next = chain[candidate];
+            }
+        }
+
+        // Short far matches cost more than literals.
+        if (length < MIN_MATCH || (length == MIN_MATCH && distance > 4096)) {
+            write_literal(&writer, in[pos]);
+            length = 1;
+        } else {
+            write_match(&writer, length, distance);
+        }
+
+        // Add covered positions to hash chains.
+        for (size_t hashed = pos; hashed < pos + length && hashed + 4 <= insize; ++hashed) {
+            const uint32_t hash = hash4(&in[hashed], hash_bits);
+            const uint32_t window_pos = hashed & (window_size - 1);
+            chain[window_pos] = heads[hash];
+            heads[hash] = window_pos + 1;
+        }
+        pos += length;
+    }
+
+    write_literal(&writer, END_OF_BLOCK);
+    if (writer.num_bits > 0) {
+        writer.data[writer.length++] = writer.bits;
+    }
+    *outsize = writer.length;
+
+    pipeline_free(heads);
+    pipeline_free(chain);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include "lodepng.h"
+
+/// @brief          Deflate data as a single fixed Huffman block, in a single pass.
+///                 Matches are found with compact LZ77 hash chains configured by 'windowsize',
+///                 'hashbits' and 'maxchainlength' of settings, and written directly,
+///                 without intermediate LZ77 symbols. Used as LodePNG 'custom_deflate'.
+/// @param out      Output - deflate data is appended. Must be freed with 'pipeline_free'.
+/// @param outsize  Output - size of deflate data.
+/// @param in       Data to deflate.
+/// @param insize   Size of data to deflate.
+/// @param settings Compression settings.
+/// @return         LodePNG error code, 0 on success.
+unsigned png_deflate_fixed(unsigned char** out, size_t* outsize, const unsigned char* in,
+                           size_t insize, const LodePNGCompressSettings* settings);
@@ -1,17 +1,25 @@
 #include "printer.h"
+#include <stdatomic.h>
 #include <string.h>
 #include "common.h"
 #include "driver/gpio.h"
 #include "esp_attr.h"
+#include "esp_cpu.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "capture.h"
 #include "image_builder.h"
+#include "isr_profiler.h"
+#include "metrics.h"
+#include "trace.h"
 
 static const char* TAG = "PRINTER";
 
+ESP_EVENT_DEFINE_BASE(PRINTER_EVENT);
+
 // Printer definitions.
 
 #define DETECT_PIN    CONFIG_GPIO_DETECT
@@ -24,6 +32,21 @@ static const char* TAG = "PRINTER";
 #define CLOCK_MASK    (1 << CLOCK_PIN)
 #define MAX_DATA_SIZE 0x280
 
+// Received data is streamed to image builder in chunks, while next chunk is being received.
+// Data packet never spans two chunks.
+#define RX_CHUNK_SIZE (2 * MAX_DATA_SIZE)
+#define RX_NUM_CHUNKS 2
+#define RX_QUEUE_SIZE 8
+#define RX_NO_CHUNK   -1
+
+// Finished print jobs waiting for image encoding task. Receiving never waits for the encoder,
+// a job not fitting the queue is dropped.
+#define ENCODE_QUEUE_SIZE 4
+// Stack of image encoding task. Timer task, which used to create images, has the same size.
+#define ENCODE_TASK_STACK_SIZE 16384
+// Unused stack of image encoding task is reported once it drops below this size.
+#define ENCODE_TASK_STACK_MARGIN 2048
+
 /// @brief Printer packet.
 typedef struct {
     uint8_t command;
@@ -41,37 +64,213 @@ typedef struct {
     uint16_t byte_counter;
     // Packet is being read.
     bool is_reading_packet;
-    // Current printer status.
-    uint8_t status;
 
     // Input/output buffers.
     uint8_t rx_data_u8;
     uint16_t rx_data_u16;
     uint8_t tx_data_u8;
+#if CONFIG_PRINTER_CAPTURE
+    // Byte sent in current byte slot.
+    uint8_t tx_byte;
+#endif
 } Printer;
 
-static SemaphoreHandle_t image_ready_semaphore;
+/// @brief Print command parameters.
+typedef struct {
+    uint8_t number_of_sheets;
+    uint8_t margins;
+    uint8_t palette;
+    uint8_t exposure;
+} PrintParams;
+
+/// @brief Image data receiver state. Owned by clock ISR.
+typedef struct {
+    // Chunk being filled, 'RX_NO_CHUNK' if none.
+    int8_t chunk;
+    // Bytes in chunk being filled.
+    uint16_t length;
+    // Chunk length at start of current data packet.
+    uint16_t packet_start;
+    // Data of current packet was dropped - no free chunk or GB ignored flow control.
+    bool packet_overrun;
+    // Valid bytes of current image part, including ones already handed over.
+    uint32_t part_length;
+    // Data of current image part was handed over to image processing task.
+    bool streaming;
+    PrintParams params;
+} Receiver;
+
+/// @brief Events handled by image processing task.
+enum RxEvent {
+    /// @brief Chunk of image data was received.
+    RX_EVENT_DATA,
+    /// @brief Print command was received - image part is finished.
+    RX_EVENT_PRINT,
+    /// @brief Initialize command was received - unfinished image part is dropped.
+    RX_EVENT_INITIALIZE,
+    /// @brief Link is idle - image is created from received parts.
+    RX_EVENT_IMAGE_TIMEOUT
+};
+
+/// @brief Message to image processing task, from clock ISR or image timeout.
+typedef struct {
+    uint8_t event;
+    // Chunk holding received data, 'RX_NO_CHUNK' if none. Released by image processing task.
+    int8_t chunk;
+    uint16_t length;
+    // Parameters of print event.
+    PrintParams params;
+} RxMessage;
+
+static QueueHandle_t rx_queue;
+static QueueHandle_t encode_queue;
 static TimerHandle_t conn_timeout_timer;
 static TimerHandle_t image_timeout_timer;
 static Packet packet = {};
 static Printer printer = {};
-static ImageData image_data = {};
+static Receiver receiver = {.chunk = RX_NO_CHUNK};
+static uint8_t rx_chunks[RX_NUM_CHUNKS][RX_CHUNK_SIZE];
+// Chunk was handed over to image processing task.
+static atomic_bool rx_chunk_busy[RX_NUM_CHUNKS];
+// Current printer status. Bits are updated by clock ISR, image processing task and timers,
+// always with atomic operations - concurrent updates of different bits are never lost.
+static atomic_uint status_bits = 0;
+// Last status posted with 'PRINTER_EVENT_STATUS_CHANGED'.
+static atomic_uint notified_status = 0;
+// Link was idle, packet state is reset by clock ISR before next bit. Timer doesn't touch state
+// owned by the ISR.
+static atomic_bool link_reset_pending = false;
+// Image parts are stored. Image builder is owned by image processing task, timers check this.
+static atomic_bool parts_stored = false;
+#if CONFIG_PRINTER_SPLIT_JOBS
+// Print job was split off during current print session, until the link is idle. Its image is
+// published by the device itself, it doesn't stop following prints with paper jam.
+static atomic_bool session_split = false;
+#endif
+// Print command is acknowledged as printing right away, see 'printer_set_turbo_mode'.
+#if CONFIG_PRINTER_TURBO_MODE
+static volatile bool turbo_mode = true;
+#else
+static volatile bool turbo_mode = false;
+#endif
+
+#if CONFIG_PRINTER_ISR_PROFILING
+// Code path taken by current clock ISR execution.
+static enum IsrPath isr_path = ISR_PATH_BIT;
+#define SET_ISR_PATH(path) (isr_path = (path))
+#else
+#define SET_ISR_PATH(path)
+#endif
+
+static void set_status(uint32_t mask) { atomic_fetch_or(&status_bits, mask); }
+
+static void reset_status(uint32_t mask) { atomic_fetch_and(&status_bits, ~mask); }
+
+/// @brief Post status changed event, if status differs from last posted.
+static void notify_status(void) {
+    const uint8_t status = atomic_load(&status_bits);
+    if (atomic_exchange(&notified_status, status) != status) {
+        esp_event_post(PRINTER_EVENT, PRINTER_EVENT_STATUS_CHANGED, &status, sizeof(status), 0);
+    }
+}
 
-static void set_status(enum StatusMask mask) { printer.status |= mask; }
+/// @brief Post status changed event from ISR, if status differs from last posted.
+static void IRAM_ATTR notify_status_from_isr(void) {
+    const uint8_t status = atomic_load(&status_bits);
+    if (atomic_exchange(&notified_status, status) != status) {
+        esp_event_isr_post(PRINTER_EVENT, PRINTER_EVENT_STATUS_CHANGED, &status, sizeof(status),
+                           NULL);
+    }
+}
 
-static void reset_status(enum StatusMask mask) { printer.status &= !mask; }
+/// @brief  Take free chunk for received data, if receiver has none.
+/// @return True if receiver has a chunk.
+static bool IRAM_ATTR acquire_chunk(void) {
+    for (int8_t i = 0; i < RX_NUM_CHUNKS && receiver.chunk == RX_NO_CHUNK; ++i) {
+        if (!atomic_load(&rx_chunk_busy[i])) {
+            receiver.chunk = i;
+            receiver.length = 0;
+        }
+    }
+    return receiver.chunk != RX_NO_CHUNK;
+}
+
+/// @brief          Hand received data over to image processing task.
+///                 Chunk being filled, if any, is passed along and receiver starts a new one.
+/// @param event    Receiver event.
+static void IRAM_ATTR hand_over(enum RxEvent event) {
+    RxMessage message = {
+        .event = event, .chunk = RX_NO_CHUNK, .length = 0, .params = receiver.params};
+    if (receiver.chunk != RX_NO_CHUNK && receiver.length > 0) {
+        message.chunk = receiver.chunk;
+        message.length = receiver.length;
+        atomic_store(&rx_chunk_busy[receiver.chunk], true);
+        receiver.chunk = RX_NO_CHUNK;
+    }
+    receiver.length = 0;
+    receiver.streaming = event == RX_EVENT_DATA;
+
+    if (xQueueSendFromISR(rx_queue, &message, NULL) != pdTRUE) {
+        // Image processing task fell behind.
+        if (message.chunk != RX_NO_CHUNK) {
+            atomic_store(&rx_chunk_busy[message.chunk], false);
+            metrics_add(METRICS_RX_OVERRUNS, message.length);
+        }
+    }
+}
+
+/// @brief          Finish data packet, once its checksum is received.
+///                 Data of invalid or overrun packet is dropped and GB is asked to send it again.
+/// @param valid    Checksum is valid.
+static void IRAM_ATTR end_data_packet(bool valid) {
+    // Reported as checksum error, so GB sends the packet again.
+    if (receiver.packet_overrun) {
+        set_status(STATUS_CHECKSUM_ERROR);
+    }
+    if (receiver.chunk != RX_NO_CHUNK) {
+        if (!valid || receiver.packet_overrun) {
+            receiver.length = receiver.packet_start;
+        }
+        receiver.part_length += receiver.length - receiver.packet_start;
+        if (RX_CHUNK_SIZE - receiver.length < MAX_DATA_SIZE) {
+            hand_over(RX_EVENT_DATA);
+        }
+    }
+}
+
+/// @brief Take free chunk for next data packet. Flow control - without one, GB must wait.
+static void IRAM_ATTR reserve_chunk(void) {
+    if (acquire_chunk()) {
+        return;
+    }
+
+    // Chunk released meanwhile might have missed the flag, so it's checked again once raised.
+    set_status(STATUS_DATA_FULL);
+    if (acquire_chunk()) {
+        reset_status(STATUS_DATA_FULL);
+    }
+}
 
 /// @brief Handle byte, once received.
 ///        Command specific operations are performed during handling of 'data' section.
 static void process_byte() {
     // 'else if' is not used intentionally in this function.
     // This is to allow commands handling and checksum receiving.
+    metrics_inc(METRICS_RX_BYTES);
+    SET_ISR_PATH(ISR_PATH_BYTE);
+#if CONFIG_PRINTER_CAPTURE
+    capture_record(printer.rx_data_u8, printer.tx_byte, 0);
+#endif
+    trace_link_byte();
 
     // Command.
     if (printer.byte_counter == 0) {
         packet.command = printer.rx_data_u8;
         packet.computed_checksum = printer.rx_data_u8;
 
+        // Errors are reported for the packet they occurred in.
+        reset_status(STATUS_CHECKSUM_ERROR | STATUS_PACKET_ERROR | STATUS_OTHER_ERROR);
+
         // Check if command is valid.
         switch (packet.command) {
             case 0x01:
@@ -81,6 +280,7 @@ static void process_byte() {
                 break;
             default: {
                 set_status(STATUS_PACKET_ERROR);
+                metrics_inc(METRICS_PACKET_ERRORS);
             }
         }
     }
@@ -95,9 +295,15 @@ static void process_byte() {
             set_status(STATUS_OTHER_ERROR);
         }
 
-        // Check if there's a processed image in the memory.
-        if (image_png_buffer() != NULL) {
+        // Check if there's a processed image in the memory, from an earlier print session.
+#if CONFIG_PRINTER_SPLIT_JOBS
+        if (image_png_ready() && !atomic_load(&session_split)) {
+#else
+        if (image_png_ready()) {
+#endif
             set_status(STATUS_PAPER_JAM);
+        } else {
+            reset_status(STATUS_PAPER_JAM);
         }
     }
 
@@ -123,6 +329,7 @@ static void process_byte() {
         }
         if (!length_valid) {
             set_status(STATUS_PACKET_ERROR);
+            metrics_inc(METRICS_PACKET_ERRORS);
         }
     }
 
@@ -137,13 +344,13 @@ static void process_byte() {
         switch (packet.command) {
             // Initialize.
             case 0x01: {
-                // Clear printer image data.
-                image_data.number_of_sheets = 0;
-                image_data.margins = 0;
-                image_data.palette = 0;
-                image_data.exposure = 0;
-                image_data.length = 0;
-                reset_status(STATUS_DATA_FULL);
+                // Drop unfinished image part. Handled on every byte, part is dropped once.
+                memset(&receiver.params, 0, sizeof(PrintParams));
+                receiver.part_length = 0;
+                receiver.length = 0;
+                if (receiver.streaming) {
+                    hand_over(RX_EVENT_INITIALIZE);
+                }
                 reset_status(STATUS_DATA_UNPROCESSED);
                 break;
             }
@@ -152,20 +359,27 @@ static void process_byte() {
                 // Read image data, then allow print task to handle printing.
                 switch (data_index) {
                     case 0: {
-                        image_data.number_of_sheets = printer.rx_data_u8;
+                        receiver.params.number_of_sheets = printer.rx_data_u8;
                         break;
                     }
                     case 1: {
-                        image_data.margins = printer.rx_data_u8;
+                        receiver.params.margins = printer.rx_data_u8;
                         break;
                     }
                     case 2: {
-                        image_data.palette = printer.rx_data_u8;
+                        receiver.params.palette = printer.rx_data_u8;
                         break;
                     }
                     case 3: {
-                        image_data.exposure = printer.rx_data_u8;
-                        xSemaphoreGiveFromISR(image_ready_semaphore, NULL);
+                        receiver.params.exposure = printer.rx_data_u8;
+                        trace_record(TRACE_PRINT_COMMAND, TRACE_INSTANT);
+                        // Reported in status of this packet, GB sees print accepted without
+                        // polling. Cleared once image builder owns the data.
+                        if (turbo_mode) {
+                            set_status(STATUS_CURRENTLY_PRINTING);
+                        }
+                        receiver.part_length = 0;
+                        hand_over(RX_EVENT_PRINT);
                         break;
                     }
                 }
@@ -174,22 +388,25 @@ static void process_byte() {
             }
             // Fill buffer.
             case 0x04: {
-                image_data.data[image_data.length] = printer.rx_data_u8;
-                packet.computed_checksum += printer.rx_data_u8;
-                ++image_data.length;
-
-                // Check if image data is full.
-                if (image_data.length == IMAGE_BUFFER_SIZE) {
-                    set_status(STATUS_DATA_FULL);
+                if (data_index == 0) {
+                    receiver.packet_overrun = !acquire_chunk();
+                    receiver.packet_start = receiver.length;
                 }
-
+                // Data is dropped if GB ignored flow control.
+                if (receiver.chunk != RX_NO_CHUNK && receiver.length < RX_CHUNK_SIZE) {
+                    rx_chunks[receiver.chunk][receiver.length++] = printer.rx_data_u8;
+                } else {
+                    receiver.packet_overrun = true;
+                    metrics_inc(METRICS_RX_OVERRUNS);
+                }
+                packet.computed_checksum += printer.rx_data_u8;
                 break;
             }
             // Check status.
             case 0x0F: {
                 // Unprocessed data flag is set here.
                 // This is to avoid flag being raised once any data arrived.
-                if (image_data.length > 0) {
+                if (receiver.part_length > 0) {
                     set_status(STATUS_DATA_UNPROCESSED);
                 }
                 break;
@@ -205,11 +422,18 @@ static void process_byte() {
     // Checksum high.
     if (printer.byte_counter == 5 + packet.length) {
         packet.received_checksum |= (printer.rx_data_u8 & 0xFF) << 8;
+        SET_ISR_PATH(ISR_PATH_CHECKSUM);
 
         // Check if checksum is valid.
-        if (packet.received_checksum != packet.computed_checksum) {
+        const bool checksum_valid = packet.received_checksum == packet.computed_checksum;
+        if (!checksum_valid) {
             set_status(STATUS_CHECKSUM_ERROR);
+            metrics_inc(METRICS_CHECKSUM_ERRORS);
+        }
+        if (packet.command == 0x04 && packet.length > 0) {
+            end_data_packet(checksum_valid);
         }
+        reserve_chunk();
 
         // Once checksum is received - always send '0x81'.
         printer.tx_data_u8 = 0x81;
@@ -217,7 +441,12 @@ static void process_byte() {
 
     // Printer status.
     if (printer.byte_counter == 6 + packet.length) {
-        printer.tx_data_u8 = printer.status;
+        printer.tx_data_u8 = atomic_load(&status_bits);
+        // Print is reported as accepted in turbo mode, even if received data is already copied.
+        if (packet.command == 0x02 && turbo_mode) {
+            printer.tx_data_u8 |= STATUS_CURRENTLY_PRINTING;
+        }
+        SET_ISR_PATH(ISR_PATH_STATUS);
     }
 
     // Allow status to be sent.
@@ -225,19 +454,33 @@ static void process_byte() {
         // Reset 'byte_counter' and 'is_reading_packet'.
         printer.byte_counter = 0;
         printer.is_reading_packet = false;
+        metrics_inc(METRICS_RX_PACKETS);
+
+        // Notify status changes once per packet.
+        notify_status_from_isr();
         return;
     }
 
     ++printer.byte_counter;
 }
 
-static void IRAM_ATTR clock_isr_handler(UNUSED void* arg) {
+/// @brief          Handle single clock edge - shift in Rx bit, process data and shift out Tx bit.
+/// @param rx_level Level of Rx line.
+/// @param tx_level Output - level to be set on Tx line.
+/// @return         True if Tx line must be updated.
+FORCE_INLINE_ATTR bool handle_clock_edge(int rx_level, int* tx_level) {
     // Reset timeout timer.
     xTimerResetFromISR(conn_timeout_timer, NULL);
     xTimerResetFromISR(image_timeout_timer, NULL);
 
+    // Start over after connection timeout.
+    if (atomic_load(&link_reset_pending)) {
+        memset(&packet, 0, sizeof(Packet));
+        memset(&printer, 0, sizeof(Printer));
+        atomic_store(&link_reset_pending, false);
+    }
+
     // Read data.
-    int rx_level = gpio_get_level(RX_PIN);
     printer.rx_data_u8 <<= 1;
     printer.rx_data_u8 |= rx_level & 0x01;
     printer.rx_data_u16 <<= 1;
@@ -249,7 +492,11 @@ static void IRAM_ATTR clock_isr_handler(UNUSED void* arg) {
         printer.bit_counter = 0;
         printer.byte_counter = 0;
         printer.is_reading_packet = true;
-        return;
+        SET_ISR_PATH(ISR_PATH_SYNC);
+#if CONFIG_PRINTER_CAPTURE
+        capture_record(kSyncWord & 0xFF, 0, CAPTURE_FLAG_SYNC);
+#endif
+        return false;
     }
 
     // Process received byte.
@@ -257,6 +504,9 @@ static void IRAM_ATTR clock_isr_handler(UNUSED void* arg) {
         if (printer.bit_counter == 7) {
             process_byte();
             printer.bit_counter = 0;
+#if CONFIG_PRINTER_CAPTURE
+            printer.tx_byte = printer.tx_data_u8;
+#endif
         } else {
             ++printer.bit_counter;
         }
@@ -264,65 +514,193 @@ static void IRAM_ATTR clock_isr_handler(UNUSED void* arg) {
 
     // Write data.
     // Data must be set before next rising edge.
-    int tx_level = printer.tx_data_u8 & 0x80;
+    *tx_level = printer.tx_data_u8 & 0x80;
     printer.tx_data_u8 <<= 1;
-    gpio_set_level(TX_PIN, tx_level);
+    return true;
+}
+
+static void IRAM_ATTR clock_isr_handler(UNUSED void* arg) {
+    const esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+#if CONFIG_PRINTER_ISR_PROFILING
+    // Previous edge belongs to the same byte if this isn't its first bit.
+    const bool intra_byte = printer.is_reading_packet && printer.bit_counter > 0;
+    isr_path = ISR_PATH_BIT;
+#endif
+
+    int tx_level = 0;
+    if (handle_clock_edge(gpio_get_level(RX_PIN), &tx_level)) {
+        gpio_set_level(TX_PIN, tx_level);
+    }
+
+    const esp_cpu_cycle_count_t end_cycles = esp_cpu_get_cycle_count();
+    metrics_observe(METRICS_ISR_DURATION_CYCLES, end_cycles - start_cycles);
+#if CONFIG_PRINTER_ISR_PROFILING
+    isr_profiler_record(isr_path, start_cycles, end_cycles, intra_byte);
+#endif
+}
+
+static void IRAM_ATTR detect_isr_handler(UNUSED void* arg) {
+    esp_event_isr_post(PRINTER_EVENT, PRINTER_EVENT_CONNECTION_CHANGED, NULL, 0, NULL);
+}
+
+/// @brief Release chunk handed over by clock ISR, GB can send more data.
+///        Chunk is released before the flag is cleared - see 'reserve_chunk'.
+static void release_chunk(int8_t chunk) {
+    atomic_store(&rx_chunk_busy[chunk], false);
+    reset_status(STATUS_DATA_FULL);
 }
 
+/// @brief Hand received image parts over to image encoding task as a print job.
+static void finish_job(void) {
+    ImageJob* job = image_take_job();
+    if (job == NULL) {
+        ESP_LOGE(TAG, "Image data dropped, out of memory");
+        metrics_inc(METRICS_JOBS_REJECTED);
+        return;
+    }
+    // Image encoding task fell behind. Job waits for it instead of being dropped, received data
+    // isn't released meanwhile, so GB is held with flow control.
+    if (xQueueSend(encode_queue, &job, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Image encoding task fell behind, waiting");
+        xQueueSend(encode_queue, &job, portMAX_DELAY);
+    }
+}
+
+/// @brief  Image encoding task creates images of finished print jobs, while next one is received.
+static void encode_image_task(UNUSED void* arg) {
+    ESP_LOGD(TAG, "Image encoding task started");
+    for (;;) {
+        ImageJob* job;
+        if (!xQueueReceive(encode_queue, &job, portMAX_DELAY)) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Image data is available - processing");
+        esp_err_t result = image_process_job(job);
+        if (result != ESP_OK) {
+            ESP_LOGE(TAG, "Image processing failed: %s", esp_err_to_name(result));
+        }
+
+        // Encoder is the deepest stack user.
+        const UBaseType_t stack_left = uxTaskGetStackHighWaterMark(NULL);
+        ESP_LOGD(TAG, "Image encoding task stack high-water mark: %u bytes", stack_left);
+        if (stack_left < ENCODE_TASK_STACK_MARGIN) {
+            ESP_LOGW(TAG, "Image encoding task is close to stack overflow: %u bytes left",
+                     stack_left);
+        }
+    }
+}
+
+/// @brief  Image processing task owns image builder - parts are added here only.
+///         Finished print jobs are handed over to image encoding task.
 static void process_image_task(UNUSED void* arg) {
     ESP_LOGD(TAG, "Image processing task started");
     for (;;) {
-        if (!xSemaphoreTake(image_ready_semaphore, portMAX_DELAY)) {
+        RxMessage message;
+        if (!xQueueReceive(rx_queue, &message, portMAX_DELAY)) {
             continue;
         }
+        bool job_end = false;
 
         // Printing is active.
-        set_status(STATUS_CURRENTLY_PRINTING);
-
-        // Print image information.
-        ESP_LOGV(TAG, "Image received");
-        ESP_LOGV(TAG, "Sheets:   %02x", image_data.number_of_sheets);
-        ESP_LOGV(TAG, "Margins:  %02x", image_data.margins);
-        ESP_LOGV(TAG, "Palette:  %02x", image_data.palette);
-        ESP_LOGV(TAG, "Exposure: %02x", image_data.exposure);
-        ESP_LOGV(TAG, "Length:   %04x", image_data.length);
-        ESP_LOGV(TAG, "Data:     %02x %02x %02x %02x...", image_data.data[0], image_data.data[1],
-                 image_data.data[2], image_data.data[3]);
-
-        // Add image data to image builder.
-        ESP_ERROR_CHECK(image_add_data(&image_data));
-
-        // Printing is not active.
-        reset_status(STATUS_CURRENTLY_PRINTING);
-
-        // Received data is now processed.
-        reset_status(STATUS_DATA_UNPROCESSED);
+        if (message.event == RX_EVENT_PRINT) {
+            set_status(STATUS_CURRENTLY_PRINTING);
+        }
+
+        // Stream received data to image builder.
+        // Data is dropped if it doesn't fit into memory, printing goes on.
+        if (message.chunk != RX_NO_CHUNK) {
+            image_append_data(rx_chunks[message.chunk], message.length);
+            release_chunk(message.chunk);
+        }
+
+        switch (message.event) {
+            case RX_EVENT_INITIALIZE: {
+                image_discard_part();
+                break;
+            }
+            case RX_EVENT_PRINT: {
+                // Print image information.
+                ESP_LOGV(TAG, "Image received");
+                ESP_LOGV(TAG, "Sheets:   %02x", message.params.number_of_sheets);
+                ESP_LOGV(TAG, "Margins:  %02x", message.params.margins);
+                ESP_LOGV(TAG, "Palette:  %02x", message.params.palette);
+                ESP_LOGV(TAG, "Exposure: %02x", message.params.exposure);
+
+                // Add image part to image builder.
+                if (image_finish_part(message.params.palette, message.params.exposure) != ESP_OK) {
+                    ESP_LOGW(TAG, "Image data dropped");
+                }
+
+                // Printing is not active.
+                reset_status(STATUS_CURRENTLY_PRINTING);
+
+                // Received data is now processed.
+                reset_status(STATUS_DATA_UNPROCESSED);
+
+#if CONFIG_PRINTER_SPLIT_JOBS
+                // Trailing margin feeds the paper out - print job is finished.
+                job_end = (message.params.margins & 0x0F) > 0;
+                if (job_end) {
+                    atomic_store(&session_split, true);
+                }
+#endif
+                break;
+            }
+            case RX_EVENT_IMAGE_TIMEOUT: {
+                job_end = true;
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        notify_status();
+
+        // Image is created by image encoding task, received data keeps being released meanwhile.
+        if (job_end && image_num_parts() > 0) {
+            if (message.event == RX_EVENT_PRINT) {
+                trace_record(TRACE_JOB_END, TRACE_INSTANT);
+            }
+            finish_job();
+        }
+        atomic_store(&parts_stored, image_num_parts() > 0);
     }
 }
 
 void conn_timeout_cb(UNUSED TimerHandle_t timer_handle) {
     ESP_LOGV(TAG, "Connection timeout");
 
-    // Reset state of the printer.
-    memset(&packet, 0, sizeof(Packet));
-    memset(&printer, 0, sizeof(Printer));
+#if CONFIG_PRINTER_ISR_PROFILING
+    // Link is idle - report clock ISR timings.
+    isr_profiler_log();
+#endif
+
+    // Reset state of the printer. Status of received data is kept, image processing task owns it.
+    atomic_store(&link_reset_pending, true);
+    reset_status(STATUS_CHECKSUM_ERROR | STATUS_PACKET_ERROR | STATUS_OTHER_ERROR);
+    notify_status();
 }
 
 void image_timeout_cb(UNUSED TimerHandle_t timer_handle) {
     ESP_LOGV(TAG, "Image timeout");
 
+#if CONFIG_PRINTER_SPLIT_JOBS
+    // Link is idle - print session is over.
+    atomic_store(&session_split, false);
+#endif
+
     // Skip if no image is available.
-    if (image_num_parts() == 0) {
+    if (!atomic_load(&parts_stored)) {
         return;
     }
 
-    // Process available data to create an image.
-    ESP_LOGI(TAG, "Image data is available - processing");
-    ESP_ERROR_CHECK(image_process());
-
-    // Reset state of the image.
-    image_clear();
-    memset(&image_data, 0, sizeof(ImageData));
+    // Image is created by image processing task. Retried with next timeout if its queue is full.
+    trace_record(TRACE_IMAGE_TIMEOUT, TRACE_INSTANT);
+    const RxMessage message = {.event = RX_EVENT_IMAGE_TIMEOUT, .chunk = RX_NO_CHUNK};
+    if (xQueueSend(rx_queue, &message, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Image processing task is busy");
+    }
 }
 
 esp_err_t printer_init(void) {
@@ -356,15 +734,19 @@ esp_err_t printer_init(void) {
     ESP_ERROR_RETURN(gpio_config(&io_conf));
 
     ESP_LOGD(TAG, "Initializing detect pin %d", DETECT_PIN);
-    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pin_bit_mask = DETECT_MASK;
     io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
     io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
     ESP_ERROR_RETURN(gpio_config(&io_conf));
 
-    // Create semaphores.
-    image_ready_semaphore = xSemaphoreCreateBinary();
+    // Create queues of received data and finished print jobs.
+    rx_queue = xQueueCreate(RX_QUEUE_SIZE, sizeof(RxMessage));
+    encode_queue = xQueueCreate(ENCODE_QUEUE_SIZE, sizeof(ImageJob*));
+    if (rx_queue == NULL || encode_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
     // Create and start timers.
     const int kConnTimeoutTicks = pdMS_TO_TICKS(100);
@@ -378,7 +760,9 @@ esp_err_t printer_init(void) {
 
     // Start task for processing packets and images.
     ESP_LOGD(TAG, "Creating packet and image processing tasks");
-    xTaskCreate(process_image_task, "process_image_task", 2048, NULL, 1, NULL);
+    // Received data is handled ahead of image encoding.
+    xTaskCreate(process_image_task, "process_image_task", 2048, NULL, 2, NULL);
+    xTaskCreate(encode_image_task, "encode_image_task", ENCODE_TASK_STACK_SIZE, NULL, 1, NULL);
 
     // Configure interrupt.
     ESP_LOGD(TAG, "Configuring clock pin interrupt");
@@ -390,9 +774,51 @@ esp_err_t printer_init(void) {
     // ISR handler for clock pin.
     ESP_ERROR_RETURN(gpio_isr_handler_add(CLOCK_PIN, clock_isr_handler, NULL));
 
+    // ISR handler for detect pin.
+    ESP_ERROR_RETURN(gpio_isr_handler_add(DETECT_PIN, detect_isr_handler, NULL));
+
     return ESP_OK;
 }
 
+#if CONFIG_PRINTER_LINK_SIMULATOR || CONFIG_PRINTER_BENCHMARK
+// Protects printer state while simulated clock edges are handled.
+static portMUX_TYPE simulation_lock = portMUX_INITIALIZER_UNLOCKED;
+// Simulated Tx line level.
+static int simulation_tx_level = 0;
+
+esp_err_t printer_simulation_begin(void) {
+    ESP_LOGI(TAG, "Link simulation started");
+    return gpio_intr_disable(CLOCK_PIN);
+}
+
+uint8_t printer_simulation_exchange(uint8_t byte) {
+    uint8_t received = 0;
+    portENTER_CRITICAL(&simulation_lock);
+    for (int b = 7; b >= 0; --b) {
+        // GB samples Tx line set on previous edge.
+        received = received << 1 | (simulation_tx_level ? 1 : 0);
+        int tx_level = 0;
+        if (handle_clock_edge((byte >> b) & 0x01, &tx_level)) {
+            simulation_tx_level = tx_level;
+        }
+    }
+    portEXIT_CRITICAL(&simulation_lock);
+    return received;
+}
+
+esp_err_t printer_simulation_end(void) {
+    ESP_LOGI(TAG, "Link simulation ended");
+    return gpio_intr_enable(CLOCK_PIN);
+}
+#endif
+
 bool printer_gb_connected(void) { return gpio_get_level(DETECT_PIN) > 0; }
 
-uint8_t printer_status(void) { return printer.status; }
\ No newline at end of file
+void printer_set_turbo_mode(bool enabled) {
+    turbo_mode = enabled;
+    ESP_LOGI(TAG, "Turbo mode %s", enabled ? "enabled" : "disabled");
+}
+
+bool printer_turbo_mode(void) { return turbo_mode; }
+
+uint8_t printer_status(void) { return atomic_load(&status_bits); }
\ No newline at end of file
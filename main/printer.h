@@ -1,7 +1,21 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
+#include "esp_event.h"
+#include "sdkconfig.h"
+
+/// @brief Printer event base.
+ESP_EVENT_DECLARE_BASE(PRINTER_EVENT);
+
+/// @brief Printer events.
+enum PrinterEvent {
+    /// @brief Printer status changed. Event data contains new status.
+    PRINTER_EVENT_STATUS_CHANGED,
+    /// @brief GB connection detect pin changed state.
+    PRINTER_EVENT_CONNECTION_CHANGED
+};
 
 /// @brief Status masks.
 enum StatusMask {
@@ -9,7 +23,7 @@ enum StatusMask {
     STATUS_CHECKSUM_ERROR = 1 << 0,
     /// @brief Currently printing/copying data to image builder.
     STATUS_CURRENTLY_PRINTING = 1 << 1,
-    /// @brief Image data full.
+    /// @brief No free receive buffer - GB waits before sending more image data.
     STATUS_DATA_FULL = 1 << 2,
     /// @brief Unprocessed data available in memory.
     STATUS_DATA_UNPROCESSED = 1 << 3,
@@ -31,4 +45,30 @@ esp_err_t printer_init(void);
 bool printer_gb_connected(void);
 
 /// @return Current printer status. Use 'StatusMask' enum to decode.
-uint8_t printer_status(void);
\ No newline at end of file
+uint8_t printer_status(void);
+
+/// @brief          Enable or disable turbo mode.
+///                 In turbo mode, print command is reported as printing in its own response
+///                 and printing ends as soon as image builder owns the data. GB doesn't wait
+///                 for printing to start, nor for image encoding.
+/// @param enabled  True to enable turbo mode.
+void printer_set_turbo_mode(bool enabled);
+
+/// @return True if turbo mode is enabled.
+bool printer_turbo_mode(void);
+
+#if CONFIG_PRINTER_LINK_SIMULATOR || CONFIG_PRINTER_BENCHMARK
+/// @brief  Start link simulation. Clock interrupt is disabled until simulation ends.
+/// @return Error code.
+esp_err_t printer_simulation_begin(void);
+
+/// @brief      Exchange single byte with the printer, bit by bit, as GB would over link cable.
+///             Must be called between 'printer_simulation_begin' and 'printer_simulation_end'.
+/// @param byte Byte sent by GB.
+/// @return     Byte received by GB.
+uint8_t printer_simulation_exchange(uint8_t byte);
+
+/// @brief  End link simulation and re-enable clock interrupt.
+/// @return Error code.
+esp_err_t printer_simulation_end(void);
+#endif
\ No newline at end of file
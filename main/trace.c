@@ -0,0 +1,339 @@
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#if CONFIG_PRINTER_TRACE
+
+#define TRACE_JOBS CONFIG_PRINTER_TRACE_JOBS
+// Max number of events per job. Fits "print all" of 30 photos.
+#define TRACE_MAX_EVENTS 128
+// Output is flushed once there's no room for another event.
+#define MAX_OBJECT_LENGTH 160
+
+/// @brief Single recorded event.
+typedef struct {
+    // Time in microseconds since boot, truncated to 32 bits.
+    uint32_t timestamp_us;
+    uint8_t event;
+    uint8_t phase;
+} TraceRecord;
+
+/// @brief Recorded print job.
+typedef struct {
+    // Job number, starting from 1.
+    uint32_t id;
+    // Hash of the image created from the job. Valid once finished, unless failed.
+    uint32_t image_hash;
+    bool finished;
+    bool failed;
+    // First HTTP response was recorded.
+    bool sent;
+    uint16_t num_events;
+    // Number of events not recorded because job was full.
+    uint16_t dropped;
+    TraceRecord events[TRACE_MAX_EVENTS];
+} TraceJob;
+
+/// @brief Timeline rows of a job.
+enum TraceThread { THREAD_LINK = 1, THREAD_PRINTER, THREAD_IMAGE, THREAD_HTTP, NUM_THREADS };
+
+static const char* event_names[TRACE_NUM_EVENTS] = {
+    [TRACE_FIRST_BYTE] = "first byte",
+    [TRACE_PRINT_COMMAND] = "print command",
+    [TRACE_ADD_DATA] = "image_add_data",
+    [TRACE_IMAGE_TIMEOUT] = "image timeout",
+    [TRACE_JOB_END] = "job end",
+    [TRACE_BITMAP] = "bitmap",
+    [TRACE_ENCODE] = "lodepng_encode",
+    [TRACE_PUBLISH] = "publish",
+    [TRACE_FIRST_HTTP_BYTE] = "first HTTP byte",
+    [TRACE_JOB_FAILED] = "job failed",
+};
+
+static const uint8_t event_threads[TRACE_NUM_EVENTS] = {
+    [TRACE_FIRST_BYTE] = THREAD_LINK,      [TRACE_PRINT_COMMAND] = THREAD_LINK,
+    [TRACE_ADD_DATA] = THREAD_PRINTER,     [TRACE_IMAGE_TIMEOUT] = THREAD_IMAGE,
+    [TRACE_JOB_END] = THREAD_IMAGE,
+    [TRACE_BITMAP] = THREAD_IMAGE,         [TRACE_ENCODE] = THREAD_IMAGE,
+    [TRACE_PUBLISH] = THREAD_IMAGE,        [TRACE_FIRST_HTTP_BYTE] = THREAD_HTTP,
+    [TRACE_JOB_FAILED] = THREAD_IMAGE,
+};
+
+static const char* thread_names[NUM_THREADS] = {
+    [THREAD_LINK] = "link",
+    [THREAD_PRINTER] = "printer",
+    [THREAD_IMAGE] = "image",
+    [THREAD_HTTP] = "http",
+};
+
+static const char phase_types[] = {
+    [TRACE_INSTANT] = 'i',
+    [TRACE_BEGIN] = 'B',
+    [TRACE_END] = 'E',
+};
+
+static TraceJob jobs[TRACE_JOBS];
+// Total number of opened jobs, including overwritten ones. Job ids are never reused, so a job
+// taken for processing can't be confused with a newer one.
+static uint32_t job_count = 0;
+// Oldest job not removed by 'trace_clear'.
+static uint32_t first_job_id = 1;
+// Last opened job is still being received.
+static volatile bool job_open = false;
+// Protects jobs - events are recorded from clock ISR and from tasks.
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief Get last opened job. Must be called with lock held.
+static TraceJob* IRAM_ATTR current_job(void) { return &jobs[(job_count - 1) % TRACE_JOBS]; }
+
+/// @brief  Find job by id. Must be called with lock held.
+/// @return Job, NULL if it was overwritten or removed.
+static TraceJob* find_job(uint32_t id) {
+    if (id < first_job_id || id > job_count) {
+        return NULL;
+    }
+    TraceJob* job = &jobs[(id - 1) % TRACE_JOBS];
+    return job->id == id ? job : NULL;
+}
+
+/// @brief Open new job, overwriting oldest one. Must be called with lock held.
+static void IRAM_ATTR open_job(void) {
+    ++job_count;
+    TraceJob* job = current_job();
+    job->id = job_count;
+    job->image_hash = 0;
+    job->finished = false;
+    job->failed = false;
+    job->sent = false;
+    job->num_events = 0;
+    job->dropped = 0;
+    job_open = true;
+}
+
+/// @brief Append event to job. Must be called with lock held.
+static void IRAM_ATTR append(TraceJob* job, enum TraceEvent event, enum TracePhase phase) {
+    if (job->num_events >= TRACE_MAX_EVENTS) {
+        ++job->dropped;
+        return;
+    }
+
+    TraceRecord* record = &job->events[job->num_events];
+    record->timestamp_us = esp_timer_get_time();
+    record->event = event;
+    record->phase = phase;
+    ++job->num_events;
+}
+
+void IRAM_ATTR trace_link_byte(void) {
+    // Fast path - called for every received byte.
+    if (job_open) {
+        return;
+    }
+
+    portENTER_CRITICAL_SAFE(&trace_lock);
+    if (!job_open) {
+        open_job();
+        append(current_job(), TRACE_FIRST_BYTE, TRACE_INSTANT);
+    }
+    portEXIT_CRITICAL_SAFE(&trace_lock);
+}
+
+void IRAM_ATTR trace_record(enum TraceEvent event, enum TracePhase phase) {
+    portENTER_CRITICAL_SAFE(&trace_lock);
+    if (!job_open) {
+        open_job();
+    }
+    append(current_job(), event, phase);
+    portEXIT_CRITICAL_SAFE(&trace_lock);
+}
+
+uint32_t trace_job_take(void) {
+    portENTER_CRITICAL(&trace_lock);
+    // Next link byte opens a new job.
+    const uint32_t id = job_open ? job_count : 0;
+    job_open = false;
+    portEXIT_CRITICAL(&trace_lock);
+    return id;
+}
+
+void trace_record_job(uint32_t id, enum TraceEvent event, enum TracePhase phase) {
+    portENTER_CRITICAL(&trace_lock);
+    TraceJob* job = find_job(id);
+    if (job != NULL) {
+        append(job, event, phase);
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+void trace_job_finish(uint32_t id, uint32_t image_hash) {
+    portENTER_CRITICAL(&trace_lock);
+    TraceJob* job = find_job(id);
+    if (job != NULL && !job->finished) {
+        job->image_hash = image_hash;
+        job->finished = true;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+void trace_job_fail(uint32_t id) {
+    portENTER_CRITICAL(&trace_lock);
+    TraceJob* job = find_job(id);
+    if (job != NULL && !job->finished) {
+        append(job, TRACE_JOB_FAILED, TRACE_INSTANT);
+        job->finished = true;
+        job->failed = true;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+void trace_image_sent(uint32_t image_hash) {
+    portENTER_CRITICAL(&trace_lock);
+    // Newest job with matching image is the one being served.
+    for (uint32_t id = job_count; id >= first_job_id; --id) {
+        TraceJob* job = find_job(id);
+        if (job == NULL) {
+            break;
+        }
+        if (job->finished && !job->failed && job->image_hash == image_hash) {
+            if (!job->sent) {
+                append(job, TRACE_FIRST_HTTP_BYTE, TRACE_INSTANT);
+                job->sent = true;
+            }
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+/// @brief Buffered JSON output.
+typedef struct {
+    TraceWriter writer;
+    void* ctx;
+    esp_err_t result;
+    // No object was written yet - next one is not preceded by a comma.
+    bool first;
+    size_t length;
+    char text[768];
+} JsonOutput;
+
+static void flush(JsonOutput* out) {
+    if (out->result == ESP_OK && out->length > 0) {
+        out->result = out->writer(out->text, out->length, out->ctx);
+    }
+    out->length = 0;
+}
+
+/// @brief Write single JSON object of 'traceEvents' array.
+static void write_object(JsonOutput* out, const char* format, ...) {
+    if (!out->first) {
+        out->text[out->length++] = ',';
+    }
+    out->first = false;
+
+    va_list args;
+    va_start(args, format);
+    const int length =
+        vsnprintf(out->text + out->length, sizeof(out->text) - out->length, format, args);
+    va_end(args);
+    out->length += length;
+    if (out->length >= sizeof(out->text)) {
+        out->length = sizeof(out->text) - 1;
+    }
+
+    if (sizeof(out->text) - out->length < MAX_OBJECT_LENGTH) {
+        flush(out);
+    }
+}
+
+static void export_job(JsonOutput* out, const TraceJob* job) {
+    // Metadata - job is shown as process, with a thread per timeline row.
+    if (job->finished) {
+        write_object(out,
+                     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,"
+                     "\"args\":{\"name\":\"job %lu, image %08lx\"}}",
+                     job->id, job->id, job->image_hash);
+    } else {
+        write_object(out,
+                     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,"
+                     "\"args\":{\"name\":\"job %lu, in progress\"}}",
+                     job->id, job->id);
+    }
+    for (int thread = THREAD_LINK; thread < NUM_THREADS; ++thread) {
+        write_object(out,
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s\"}}",
+                     job->id, thread, thread_names[thread]);
+    }
+
+    // Events.
+    for (uint16_t i = 0; i < job->num_events; ++i) {
+        const TraceRecord* record = &job->events[i];
+        write_object(out, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":%lu,\"tid\":%d%s}",
+                     event_names[record->event], phase_types[record->phase],
+                     record->timestamp_us, job->id, event_threads[record->event],
+                     record->phase == TRACE_INSTANT ? ",\"s\":\"p\"" : "");
+    }
+    if (job->dropped > 0) {
+        write_object(out,
+                     "{\"name\":\"dropped events\",\"ph\":\"C\",\"ts\":%lu,\"pid\":%lu,"
+                     "\"args\":{\"count\":%u}}",
+                     job->events[job->num_events - 1].timestamp_us, job->id, job->dropped);
+    }
+}
+
+esp_err_t trace_export(TraceWriter writer, void* ctx) {
+    TraceJob* job = malloc(sizeof(TraceJob));
+    JsonOutput* out = malloc(sizeof(JsonOutput));
+    if (job == NULL || out == NULL) {
+        free(job);
+        free(out);
+        return ESP_ERR_NO_MEM;
+    }
+    out->writer = writer;
+    out->ctx = ctx;
+    out->result = ESP_OK;
+    out->first = true;
+    out->length = sprintf(out->text, "{\"traceEvents\":[");
+
+    portENTER_CRITICAL(&trace_lock);
+    const uint32_t count = job_count;
+    const uint32_t first_id =
+        count >= first_job_id + TRACE_JOBS ? count - TRACE_JOBS + 1 : first_job_id;
+    portEXIT_CRITICAL(&trace_lock);
+
+    // Export from oldest to newest job.
+    for (uint32_t id = first_id; id <= count && out->result == ESP_OK; ++id) {
+        // Copy is short enough not to delay clock ISR noticeably.
+        portENTER_CRITICAL(&trace_lock);
+        memcpy(job, &jobs[(id - 1) % TRACE_JOBS], sizeof(TraceJob));
+        portEXIT_CRITICAL(&trace_lock);
+
+        // Skip job overwritten during export.
+        if (job->id == id) {
+            export_job(out, job);
+        }
+    }
+
+    out->length += snprintf(out->text + out->length, sizeof(out->text) - out->length,
+                            "],\"displayTimeUnit\":\"ms\"}");
+    flush(out);
+
+    const esp_err_t result = out->result;
+    free(job);
+    free(out);
+    return result;
+}
+
+void trace_clear(void) {
+    portENTER_CRITICAL(&trace_lock);
+    first_job_id = job_count + 1;
+    job_open = false;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/// @brief Traced events of a print job.
+enum TraceEvent {
+    /// @brief First link byte of the job.
+    TRACE_FIRST_BYTE,
+    /// @brief Print command (0x02) received.
+    TRACE_PRINT_COMMAND,
+    /// @brief Image data added to image builder.
+    TRACE_ADD_DATA,
+    /// @brief Image timeout expired, image processing starts.
+    TRACE_IMAGE_TIMEOUT,
+    /// @brief Print with trailing margin finished the job, image processing starts.
+    TRACE_JOB_END,
+    /// @brief Bitmap creation.
+    TRACE_BITMAP,
+    /// @brief PNG encoding.
+    TRACE_ENCODE,
+    /// @brief Image publishing.
+    TRACE_PUBLISH,
+    /// @brief First HTTP response carrying the image.
+    TRACE_FIRST_HTTP_BYTE,
+    /// @brief Job was dropped without an image.
+    TRACE_JOB_FAILED,
+    TRACE_NUM_EVENTS
+};
+
+/// @brief Event phase.
+enum TracePhase {
+    /// @brief Point in time.
+    TRACE_INSTANT,
+    /// @brief Start of a duration.
+    TRACE_BEGIN,
+    /// @brief End of a duration.
+    TRACE_END
+};
+
+/// @brief          Callback used to export trace.
+/// @param data     Data to be written.
+/// @param length   Length of data.
+/// @param ctx      User context.
+/// @return         Error code. Export is aborted on error.
+typedef esp_err_t (*TraceWriter)(const void* data, size_t length, void* ctx);
+
+#if CONFIG_PRINTER_TRACE
+/// @brief  Handle received link byte. Opens new job and records its first byte if no job is open.
+///         Must be called from clock ISR only.
+void trace_link_byte(void);
+
+/// @brief          Record event of the job being received. Opens new job if no job is open.
+///                 Can be called from any task and from ISR.
+/// @param event    Event to record.
+/// @param phase    Event phase.
+void trace_record(enum TraceEvent event, enum TracePhase phase);
+
+/// @brief  Detach the job being received once it's handed over for processing. Link bytes
+///         received afterwards open a new job.
+/// @return Id of the detached job, to record its processing. 0 if no job is open.
+uint32_t trace_job_take(void);
+
+/// @brief          Record event of a job taken with 'trace_job_take'.
+///                 Ignored if the job was overwritten or removed.
+/// @param id       Job id.
+/// @param event    Event to record.
+/// @param phase    Event phase.
+void trace_record_job(uint32_t id, enum TraceEvent event, enum TracePhase phase);
+
+/// @brief              Close job once its image is published.
+/// @param id           Job id.
+/// @param image_hash   Hash of the published image.
+void trace_job_finish(uint32_t id, uint32_t image_hash);
+
+/// @brief      Close job dropped without an image. Ignored if the job is already closed.
+/// @param id   Job id.
+void trace_job_fail(uint32_t id);
+
+/// @brief              Record first HTTP response of the image, if not recorded yet.
+/// @param image_hash   Hash of the sent image.
+void trace_image_sent(uint32_t image_hash);
+#else
+// Tracing is disabled - recording is compiled out. Job id is still used, it might be kept in a
+// variable just for tracing.
+#define trace_link_byte()
+#define trace_record(event, phase)
+#define trace_job_take() 0
+#define trace_record_job(id, event, phase) ((void)(id))
+#define trace_job_finish(id, image_hash) ((void)(id))
+#define trace_job_fail(id) ((void)(id))
+#define trace_image_sent(image_hash)
+#endif
+
+/// @brief          Export recorded jobs as Chrome trace event JSON.
+///                 Each job is shown as a separate process.
+/// @param writer   Output callback.
+/// @param ctx      User context passed to 'writer'.
+/// @return         Error code.
+esp_err_t trace_export(TraceWriter writer, void* ctx);
+
+/// @brief Remove all recorded jobs.
+void trace_clear(void);
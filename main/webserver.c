@@ -1,12 +1,25 @@
 #include "webserver.h"
+#include <stdint.h>
+#include <string.h>
 #include <sys/stat.h>
+#include "benchmark.h"
+#include "capture.h"
 #include "common.h"
+#include "esp_event.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "esp_spiffs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "image_builder.h"
+#include "isr_profiler.h"
+#include "link_sim.h"
 #include "mdns.h"
+#include "metrics.h"
 #include "printer.h"
+#include "trace.h"
 
 static const char* TAG = "WEBSERVER";
 
@@ -14,6 +27,98 @@ static httpd_handle_t handle = NULL;
 static const char* index_html_path = "/spiffs/index.html";
 static char index_html_data[8 * 1024];
 
+// Work argument used to send state to all WebSocket clients.
+#define WS_BROADCAST_FD -1
+// Max size of accepted incoming WebSocket frame.
+#define WS_MAX_RX_LENGTH 32
+
+#define ASYNC_WORKERS CONFIG_PRINTER_HTTPD_ASYNC_WORKERS
+
+/// @brief Request handed over to async worker.
+typedef struct {
+    httpd_req_t* req;
+    esp_err_t (*handler)(httpd_req_t* req);
+} AsyncRequest;
+
+static QueueHandle_t async_req_queue = NULL;
+// Counts idle async workers.
+static SemaphoreHandle_t async_worker_ready = NULL;
+static TaskHandle_t async_worker_handles[ASYNC_WORKERS];
+
+/// @return True if called from one of async workers.
+static bool is_on_async_worker(void) {
+    TaskHandle_t current_task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < ASYNC_WORKERS; ++i) {
+        if (async_worker_handles[i] == current_task) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief          Hand request over to idle async worker.
+/// @param req      Request to be handled.
+/// @param handler  Handler to be called by the worker.
+/// @return         ESP_OK if request was submitted.
+///                 ESP_ERR_TIMEOUT if all workers are busy - request must be handled in place.
+static esp_err_t submit_async_req(httpd_req_t* req, esp_err_t (*handler)(httpd_req_t* req)) {
+    // Only take requests which can be started immediately.
+    if (xSemaphoreTake(async_worker_ready, 0) == pdFALSE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Copy of the request remains valid after returning from server handler.
+    httpd_req_t* async_req = NULL;
+    esp_err_t result = httpd_req_async_handler_begin(req, &async_req);
+    if (result != ESP_OK) {
+        xSemaphoreGive(async_worker_ready);
+        return result;
+    }
+
+    AsyncRequest async_request = {.req = async_req, .handler = handler};
+    if (xQueueSend(async_req_queue, &async_request, 0) == pdFALSE) {
+        httpd_req_async_handler_complete(async_req);
+        xSemaphoreGive(async_worker_ready);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+static void async_worker_task(UNUSED void* arg) {
+    ESP_LOGD(TAG, "Async worker task started");
+    for (;;) {
+        AsyncRequest async_request;
+        if (!xQueueReceive(async_req_queue, &async_request, portMAX_DELAY)) {
+            continue;
+        }
+
+        async_request.handler(async_request.req);
+        httpd_req_async_handler_complete(async_request.req);
+
+        // Worker is idle again.
+        xSemaphoreGive(async_worker_ready);
+    }
+}
+
+static esp_err_t start_async_workers(void) {
+    async_req_queue = xQueueCreate(ASYNC_WORKERS, sizeof(AsyncRequest));
+    async_worker_ready = xSemaphoreCreateCounting(ASYNC_WORKERS, 0);
+    if (async_req_queue == NULL || async_worker_ready == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < ASYNC_WORKERS; ++i) {
+        if (xTaskCreate(async_worker_task, "async_worker_task", 4096, NULL, 5,
+                        &async_worker_handles[i]) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreGive(async_worker_ready);
+    }
+
+    return ESP_OK;
+}
+
 static esp_err_t start_spiffs(void) {
     // Initialize SPIFFS.
     esp_vfs_spiffs_conf_t conf = {.base_path = "/spiffs",
@@ -53,11 +158,13 @@ static esp_err_t start_mdns(void) {
 
 static esp_err_t main_page_get_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "main_page_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
     return httpd_resp_send(req, index_html_data, HTTPD_RESP_USE_STRLEN);
 }
 
 static esp_err_t gb_connected_get_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "gb_connected_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
     char resp[16];
     sprintf(resp, "%d", printer_gb_connected());
     return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
@@ -65,43 +172,438 @@ static esp_err_t gb_connected_get_handler(httpd_req_t* req) {
 
 static esp_err_t printer_status_get_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "printer_status_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
     char resp[16];
     sprintf(resp, "%d", printer_status());
     return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
 }
 
+static esp_err_t turbo_mode_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "turbo_mode_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    char resp[16];
+    sprintf(resp, "%d", printer_turbo_mode());
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t turbo_mode_post_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "turbo_mode_post_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    char query[32];
+    char enabled[4];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "enabled", enabled, sizeof(enabled)) != ESP_OK ||
+        (strcmp(enabled, "0") != 0 && strcmp(enabled, "1") != 0)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected enabled=0 or enabled=1");
+    }
+    printer_set_turbo_mode(enabled[0] == '1');
+    return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
+}
+
 static esp_err_t image_ready_get_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "image_ready_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
     char resp[16];
-    sprintf(resp, "%d", image_png_buffer() != NULL);
+    sprintf(resp, "%d", image_png_ready());
     return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
 }
 
+/// @brief          Parse single byte range from 'Range' header value.
+/// @param value    Header value, e.g., 'bytes=0-499', 'bytes=500-', 'bytes=-500'.
+/// @param length   Length of the resource.
+/// @param first    Output - first byte position, inclusive.
+/// @param last     Output - last byte position, inclusive.
+/// @return         ESP_OK if range is valid.
+///                 ESP_ERR_NOT_SUPPORTED if range should be ignored (unknown unit, multiple
+///                 ranges).
+///                 ESP_ERR_INVALID_SIZE if range is not satisfiable.
+static esp_err_t parse_range(const char* value, size_t length, size_t* first, size_t* last) {
+    const char* kUnit = "bytes=";
+    if (strncmp(value, kUnit, strlen(kUnit)) != 0 || strchr(value, ',') != NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const char* spec = value + strlen(kUnit);
+
+    char* end = NULL;
+    if (*spec == '-') {
+        // Suffix range - last N bytes.
+        const unsigned long suffix = strtoul(spec + 1, &end, 10);
+        if (end == spec + 1 || *end != '\0') {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (suffix == 0 || length == 0) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *first = suffix < length ? length - suffix : 0;
+        *last = length - 1;
+        return ESP_OK;
+    }
+
+    // First byte position, then optional last byte position.
+    const unsigned long first_pos = strtoul(spec, &end, 10);
+    if (end == spec || *end != '-') {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const char* last_spec = end + 1;
+    unsigned long last_pos = length - 1;
+    if (*last_spec != '\0') {
+        last_pos = strtoul(last_spec, &end, 10);
+        if (end == last_spec || *end != '\0' || last_pos < first_pos) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+    if (first_pos >= length) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *first = first_pos;
+    *last = last_pos < length ? last_pos : length - 1;
+    return ESP_OK;
+}
+
+static esp_err_t send_image(httpd_req_t* req, const ImageSnapshot* snapshot) {
+    // Image is identified by its content hash.
+    // Clients must revalidate cached image on every use.
+    char etag[16];
+    sprintf(etag, "\"%08lx\"", snapshot->hash);
+    ESP_ERROR_RETURN(httpd_resp_set_hdr(req, "ETag", etag));
+    ESP_ERROR_RETURN(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
+
+    // Respond with 304 if client already has this image.
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match,
+                                    sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag) != NULL) {
+        ESP_ERROR_RETURN(httpd_resp_set_status(req, "304 Not Modified"));
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Image data is sent from here on.
+    trace_image_sent(snapshot->hash);
+
+    // Set content type.
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, "image/png"));
+    ESP_ERROR_RETURN(httpd_resp_set_hdr(req, "Accept-Ranges", "bytes"));
+
+    // Range is ignored if 'If-Range' doesn't match current image.
+    char range[64];
+    char if_range[64];
+    if (httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) != ESP_OK ||
+        (httpd_req_get_hdr_value_str(req, "If-Range", if_range, sizeof(if_range)) == ESP_OK &&
+         strcmp(if_range, etag) != 0)) {
+        // Send whole image.
+        return httpd_resp_send(req, (const char*)snapshot->data, snapshot->length);
+    }
+
+    // Send requested part of the image, directly from the snapshot.
+    size_t first = 0;
+    size_t last = 0;
+    char content_range[48];
+    switch (parse_range(range, snapshot->length, &first, &last)) {
+        case ESP_OK: {
+            sprintf(content_range, "bytes %u-%u/%u", first, last, snapshot->length);
+            ESP_ERROR_RETURN(httpd_resp_set_hdr(req, "Content-Range", content_range));
+            ESP_ERROR_RETURN(httpd_resp_set_status(req, "206 Partial Content"));
+            return httpd_resp_send(req, (const char*)snapshot->data + first, last - first + 1);
+        }
+        case ESP_ERR_INVALID_SIZE: {
+            sprintf(content_range, "bytes */%u", snapshot->length);
+            ESP_ERROR_RETURN(httpd_resp_set_hdr(req, "Content-Range", content_range));
+            ESP_ERROR_RETURN(httpd_resp_set_status(req, "416 Range Not Satisfiable"));
+            return httpd_resp_send(req, NULL, 0);
+        }
+        default: {
+            return httpd_resp_send(req, (const char*)snapshot->data, snapshot->length);
+        }
+    }
+}
+
 static esp_err_t image_get_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "image_get_handler");
-    const size_t png_length = image_png_length();
-    const uint8_t* png_buffer = image_png_buffer();
 
-    // Image not ready, respond with 404.
-    if (png_length == 0 || png_buffer == NULL) {
+    // Long transfers are moved off the server task, so other clients are not blocked.
+    if (!is_on_async_worker() && submit_async_req(req, image_get_handler) == ESP_OK) {
+        return ESP_OK;
+    }
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    // Kept image of a previous print job is requested by its ID, current image otherwise.
+    char query[32];
+    char id[12];
+    const bool by_id = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                       httpd_query_key_value(query, "id", id, sizeof(id)) == ESP_OK;
+    const ImageSnapshot* snapshot = by_id ? image_snapshot_acquire_id(strtoul(id, NULL, 16))
+                                          : image_snapshot_acquire();
+
+    // Image not ready or not kept anymore, respond with 404.
+    if (snapshot == NULL) {
         return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Image not ready");
     }
 
-    // Set content type.
-    ESP_ERROR_RETURN(httpd_resp_set_type(req, "image/png"));
-    // Send data.
-    return httpd_resp_send(req, (const char*)png_buffer, png_length);
+    // Snapshot stays valid until released, even if image is replaced or removed meanwhile.
+    esp_err_t result = send_image(req, snapshot);
+    image_snapshot_release(snapshot);
+    return result;
+}
+
+static esp_err_t images_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "images_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    // IDs of kept images, newest first.
+    uint32_t ids[CONFIG_PRINTER_IMAGE_HISTORY];
+    const size_t num_ids = image_snapshot_ids(ids, CONFIG_PRINTER_IMAGE_HISTORY);
+    char resp[16 + CONFIG_PRINTER_IMAGE_HISTORY * 11];
+    size_t length = sprintf(resp, "[");
+    for (size_t i = 0; i < num_ids; ++i) {
+        length += sprintf(resp + length, "%s\"%08lx\"", i == 0 ? "" : ",", ids[i]);
+    }
+    sprintf(resp + length, "]");
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, HTTPD_TYPE_JSON));
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
 }
 
 static esp_err_t image_delete_handler(httpd_req_t* req) {
     ESP_LOGV(TAG, "image_delete_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
     image_png_clear();
     return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
 }
 
+static esp_err_t metrics_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "metrics_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    const size_t kMetricsTextSize = 12 * 1024;
+    char* text = malloc(kMetricsTextSize);
+    if (text == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    size_t length = metrics_format(text, kMetricsTextSize);
+    if (length >= kMetricsTextSize) {
+        ESP_LOGW(TAG, "Metrics output truncated");
+        length = kMetricsTextSize - 1;
+    }
+
+    // Prometheus text exposition format.
+    esp_err_t result = httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    if (result == ESP_OK) {
+        result = httpd_resp_send(req, text, length);
+    }
+    free(text);
+    return result;
+}
+
+#if CONFIG_PRINTER_ISR_PROFILING
+static esp_err_t isr_profile_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "isr_profile_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    char text[640];
+    isr_profiler_format(text, sizeof(text));
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, "text/plain"));
+    return httpd_resp_send(req, text, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t isr_profile_delete_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "isr_profile_delete_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    isr_profiler_reset();
+    return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
+}
+#endif
+
+#if CONFIG_PRINTER_CAPTURE || CONFIG_PRINTER_TRACE
+static esp_err_t send_chunk_writer(const void* data, size_t length, void* ctx) {
+    return httpd_resp_send_chunk((httpd_req_t*)ctx, data, length);
+}
+#endif
+
+#if CONFIG_PRINTER_CAPTURE
+static esp_err_t capture_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "capture_get_handler");
+
+    // Long transfers are moved off the server task, so other clients are not blocked.
+    if (!is_on_async_worker() && submit_async_req(req, capture_get_handler) == ESP_OK) {
+        return ESP_OK;
+    }
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    // Text log is served under '.txt' URI, binary trace otherwise.
+    const bool text = strcmp(req->uri, "/capture.txt") == 0;
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, text ? "text/plain" : "application/octet-stream"));
+    ESP_ERROR_RETURN(capture_export(send_chunk_writer, req, text));
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t capture_delete_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "capture_delete_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    capture_clear();
+    return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
+}
+#endif
+
+#if CONFIG_PRINTER_TRACE
+static esp_err_t trace_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "trace_get_handler");
+
+    // Long transfers are moved off the server task, so other clients are not blocked.
+    if (!is_on_async_worker() && submit_async_req(req, trace_get_handler) == ESP_OK) {
+        return ESP_OK;
+    }
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    // Chrome trace event format, can be opened in 'chrome://tracing' or Perfetto.
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, HTTPD_TYPE_JSON));
+    ESP_ERROR_RETURN(trace_export(send_chunk_writer, req));
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t trace_delete_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "trace_delete_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    trace_clear();
+    return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
+}
+#endif
+
+#if CONFIG_PRINTER_BENCHMARK
+static esp_err_t benchmark_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "benchmark_get_handler");
+
+    // Benchmark takes seconds, run it off the server task.
+    if (!is_on_async_worker() && submit_async_req(req, benchmark_get_handler) == ESP_OK) {
+        return ESP_OK;
+    }
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    const size_t kResultsSize = 8 * 1024;
+    char* results = malloc(kResultsSize);
+    if (results == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    esp_err_t result = benchmark_run(results, kResultsSize);
+    if (result == ESP_OK) {
+        result = httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    }
+    if (result == ESP_OK) {
+        result = httpd_resp_send(req, results, HTTPD_RESP_USE_STRLEN);
+    } else if (result == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        result = httpd_resp_send(req, "Benchmark already running or printer busy",
+                                 HTTPD_RESP_USE_STRLEN);
+    }
+    free(results);
+    return result;
+}
+#endif
+
+#if CONFIG_PRINTER_LINK_SIMULATOR
+static esp_err_t simulate_get_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "simulate_get_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+    char resp[512];
+    link_sim_format_results(resp, sizeof(resp));
+    ESP_ERROR_RETURN(httpd_resp_set_type(req, HTTPD_TYPE_JSON));
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t simulate_post_handler(httpd_req_t* req) {
+    ESP_LOGV(TAG, "simulate_post_handler");
+    metrics_inc(METRICS_HTTP_REQUESTS);
+
+    // Read parameters - scenario name and optional byte interval.
+    char query[64];
+    char scenario_name[16];
+    char byte_us[12] = "0";
+    enum LinkSimScenario scenario;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "scenario", scenario_name, sizeof(scenario_name)) != ESP_OK ||
+        link_sim_scenario_from_name(scenario_name, &scenario) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown scenario");
+    }
+    httpd_query_key_value(query, "byte_us", byte_us, sizeof(byte_us));
+
+    esp_err_t result = link_sim_start(scenario, strtoul(byte_us, NULL, 10));
+    if (result == ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_RETURN(httpd_resp_set_status(req, "409 Conflict"));
+        return httpd_resp_send(req, "Simulation already running", HTTPD_RESP_USE_STRLEN);
+    }
+    ESP_ERROR_RETURN(result);
+    return httpd_resp_send(req, "1", HTTPD_RESP_USE_STRLEN);
+}
+#endif
+
+/// @brief Send current printer state to WebSocket clients.
+///        Must be run in server task context, using 'httpd_queue_work'.
+/// @param arg Socket descriptor cast to pointer, 'WS_BROADCAST_FD' to send to all clients.
+static void ws_send_state_work(void* arg) {
+    const int target_fd = (intptr_t)arg;
+
+    // Build state message.
+    const ImageSnapshot* snapshot = image_snapshot_acquire();
+    const uint32_t image_id = snapshot != NULL ? snapshot->hash : 0;
+    const unsigned int copies = snapshot != NULL ? atomic_load(&snapshot->copies) : 0;
+    char message[112];
+    const int length = snprintf(message, sizeof(message),
+                                "{\"connected\":%d,\"status\":%d,\"image\":%d,"
+                                "\"imageId\":\"%08lx\",\"copies\":%u}",
+                                printer_gb_connected(), printer_status(), snapshot != NULL,
+                                image_id, copies);
+    image_snapshot_release(snapshot);
+    httpd_ws_frame_t frame = {
+        .final = true, .type = HTTPD_WS_TYPE_TEXT, .payload = (uint8_t*)message, .len = length};
+
+    // Send to a single client.
+    if (target_fd != WS_BROADCAST_FD) {
+        httpd_ws_send_frame_async(handle, target_fd, &frame);
+        return;
+    }
+
+    // Send to all WebSocket clients.
+    int client_fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t num_clients = CONFIG_LWIP_MAX_SOCKETS;
+    if (httpd_get_client_list(handle, &num_clients, client_fds) != ESP_OK) {
+        return;
+    }
+    for (size_t i = 0; i < num_clients; ++i) {
+        if (httpd_ws_get_fd_info(handle, client_fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+            httpd_ws_send_frame_async(handle, client_fds[i], &frame);
+        }
+    }
+}
+
+static void state_changed_handler(UNUSED void* arg, UNUSED esp_event_base_t base,
+                                  UNUSED int32_t id, UNUSED void* data) {
+    ESP_LOGV(TAG, "state_changed_handler");
+    httpd_queue_work(handle, ws_send_state_work, (void*)WS_BROADCAST_FD);
+}
+
+static esp_err_t ws_handler(httpd_req_t* req) {
+    // Handshake - send initial state once connection is established.
+    if (req->method == HTTP_GET) {
+        ESP_LOGV(TAG, "ws_handler - handshake");
+        const int fd = httpd_req_to_sockfd(req);
+        return httpd_queue_work(handle, ws_send_state_work, (void*)(intptr_t)fd);
+    }
+
+    // Incoming frames are not used - receive and discard.
+    uint8_t payload[WS_MAX_RX_LENGTH];
+    httpd_ws_frame_t frame = {.payload = payload};
+    ESP_ERROR_RETURN(httpd_ws_recv_frame(req, &frame, 0));
+    if (frame.len > sizeof(payload)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return httpd_ws_recv_frame(req, &frame, frame.len);
+}
+
 static esp_err_t start_webserver(void) {
     // Start server.
+    // Serve multiple clients - close least recently used socket once all are in use.
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_open_sockets = CONFIG_PRINTER_HTTPD_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true;
+    config.max_uri_handlers = 24;
     ESP_ERROR_RETURN(httpd_start(&handle, &config));
 
     // Register handlers.
@@ -122,6 +624,18 @@ static esp_err_t start_webserver(void) {
                                             .user_ctx = NULL};
     ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &printer_status_get));
 
+    const httpd_uri_t turbo_mode_get = {.uri = "/turbo-mode",
+                                        .method = HTTP_GET,
+                                        .handler = turbo_mode_get_handler,
+                                        .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &turbo_mode_get));
+
+    const httpd_uri_t turbo_mode_post = {.uri = "/turbo-mode",
+                                         .method = HTTP_POST,
+                                         .handler = turbo_mode_post_handler,
+                                         .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &turbo_mode_post));
+
     const httpd_uri_t image_ready_get = {.uri = "/image-ready",
                                          .method = HTTP_GET,
                                          .handler = image_ready_get_handler,
@@ -132,12 +646,97 @@ static esp_err_t start_webserver(void) {
         .uri = "/image", .method = HTTP_GET, .handler = image_get_handler, .user_ctx = NULL};
     ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &image_get));
 
+    const httpd_uri_t images_get = {
+        .uri = "/images", .method = HTTP_GET, .handler = images_get_handler, .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &images_get));
+
     const httpd_uri_t image_delete = {.uri = "/delete-image",
                                       .method = HTTP_DELETE,
                                       .handler = image_delete_handler,
                                       .user_ctx = NULL};
     ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &image_delete));
 
+    const httpd_uri_t metrics_get = {
+        .uri = "/metrics", .method = HTTP_GET, .handler = metrics_get_handler, .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &metrics_get));
+
+#if CONFIG_PRINTER_ISR_PROFILING
+    const httpd_uri_t isr_profile_get = {.uri = "/isr-profile",
+                                         .method = HTTP_GET,
+                                         .handler = isr_profile_get_handler,
+                                         .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &isr_profile_get));
+
+    const httpd_uri_t isr_profile_delete = {.uri = "/isr-profile",
+                                            .method = HTTP_DELETE,
+                                            .handler = isr_profile_delete_handler,
+                                            .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &isr_profile_delete));
+#endif
+
+#if CONFIG_PRINTER_CAPTURE
+    const httpd_uri_t capture_get = {
+        .uri = "/capture", .method = HTTP_GET, .handler = capture_get_handler, .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &capture_get));
+
+    const httpd_uri_t capture_txt_get = {.uri = "/capture.txt",
+                                         .method = HTTP_GET,
+                                         .handler = capture_get_handler,
+                                         .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &capture_txt_get));
+
+    const httpd_uri_t capture_delete = {.uri = "/capture",
+                                        .method = HTTP_DELETE,
+                                        .handler = capture_delete_handler,
+                                        .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &capture_delete));
+#endif
+
+#if CONFIG_PRINTER_TRACE
+    const httpd_uri_t trace_get = {
+        .uri = "/trace", .method = HTTP_GET, .handler = trace_get_handler, .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &trace_get));
+
+    const httpd_uri_t trace_delete = {.uri = "/trace",
+                                      .method = HTTP_DELETE,
+                                      .handler = trace_delete_handler,
+                                      .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &trace_delete));
+#endif
+
+#if CONFIG_PRINTER_BENCHMARK
+    const httpd_uri_t benchmark_get = {.uri = "/benchmark",
+                                       .method = HTTP_GET,
+                                       .handler = benchmark_get_handler,
+                                       .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &benchmark_get));
+#endif
+
+#if CONFIG_PRINTER_LINK_SIMULATOR
+    const httpd_uri_t simulate_get = {
+        .uri = "/simulate", .method = HTTP_GET, .handler = simulate_get_handler, .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &simulate_get));
+
+    const httpd_uri_t simulate_post = {.uri = "/simulate",
+                                       .method = HTTP_POST,
+                                       .handler = simulate_post_handler,
+                                       .user_ctx = NULL};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &simulate_post));
+#endif
+
+    const httpd_uri_t ws = {.uri = "/ws",
+                            .method = HTTP_GET,
+                            .handler = ws_handler,
+                            .user_ctx = NULL,
+                            .is_websocket = true};
+    ESP_ERROR_RETURN(httpd_register_uri_handler(handle, &ws));
+
+    // Push state changes to WebSocket clients.
+    ESP_ERROR_RETURN(
+        esp_event_handler_register(PRINTER_EVENT, ESP_EVENT_ANY_ID, state_changed_handler, NULL));
+    ESP_ERROR_RETURN(
+        esp_event_handler_register(IMAGE_EVENT, ESP_EVENT_ANY_ID, state_changed_handler, NULL));
+
     return ESP_OK;
 }
 
@@ -147,6 +746,7 @@ esp_err_t webserver_init(void) {
 
     // Initialize mDNS and server.
     ESP_ERROR_RETURN(start_mdns());
+    ESP_ERROR_RETURN(start_async_workers());
     ESP_ERROR_RETURN(start_webserver());
 
     return ESP_OK;
@@ -0,0 +1,114 @@
+#include "xxhash32.h"
+#include <string.h>
+
+// XXH32 as specified by xxHash project, little endian.
+
+#define PRIME1 0x9E3779B1U
+#define PRIME2 0x85EBCA77U
+#define PRIME3 0xC2B2AE3DU
+#define PRIME4 0x27D4EB2FU
+#define PRIME5 0x165667B1U
+
+static inline uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline uint32_t read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t round32(uint32_t acc, uint32_t input) {
+    return rotl(acc + input * PRIME2, 13) * PRIME1;
+}
+
+/// @brief Consume whole 16-byte stripes.
+/// @return Number of bytes consumed.
+static size_t consume_stripes(uint32_t acc[4], const uint8_t* data, size_t length) {
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + (length & ~(size_t)15);
+    uint32_t acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3];
+    while (ptr < end) {
+        acc0 = round32(acc0, read32(ptr));
+        acc1 = round32(acc1, read32(ptr + 4));
+        acc2 = round32(acc2, read32(ptr + 8));
+        acc3 = round32(acc3, read32(ptr + 12));
+        ptr += 16;
+    }
+    acc[0] = acc0;
+    acc[1] = acc1;
+    acc[2] = acc2;
+    acc[3] = acc3;
+    return ptr - data;
+}
+
+void xxhash32_init(XXHash32State* state, uint32_t seed) {
+    memset(state, 0, sizeof(XXHash32State));
+    state->seed = seed;
+    state->acc[0] = seed + PRIME1 + PRIME2;
+    state->acc[1] = seed + PRIME2;
+    state->acc[2] = seed;
+    state->acc[3] = seed - PRIME1;
+}
+
+void xxhash32_update(XXHash32State* state, const void* data, size_t length) {
+    const uint8_t* ptr = data;
+    state->total_length += length;
+
+    // Complete buffered stripe first.
+    if (state->buffer_length > 0) {
+        const size_t fill = length < 16 - state->buffer_length ? length : 16 - state->buffer_length;
+        memcpy(state->buffer + state->buffer_length, ptr, fill);
+        state->buffer_length += fill;
+        ptr += fill;
+        length -= fill;
+        if (state->buffer_length < 16) {
+            return;
+        }
+        consume_stripes(state->acc, state->buffer, 16);
+        state->buffer_length = 0;
+    }
+
+    const size_t consumed = consume_stripes(state->acc, ptr, length);
+    memcpy(state->buffer, ptr + consumed, length - consumed);
+    state->buffer_length = length - consumed;
+}
+
+uint32_t xxhash32_digest(const XXHash32State* state) {
+    uint32_t hash;
+    if (state->total_length >= 16) {
+        hash = rotl(state->acc[0], 1) + rotl(state->acc[1], 7) + rotl(state->acc[2], 12) +
+               rotl(state->acc[3], 18);
+    } else {
+        hash = state->seed + PRIME5;
+    }
+    hash += state->total_length;
+
+    // Remaining input.
+    const uint8_t* ptr = state->buffer;
+    const uint8_t* end = state->buffer + state->buffer_length;
+    while (ptr + 4 <= end) {
+        hash = rotl(hash + read32(ptr) * PRIME3, 17) * PRIME4;
+        ptr += 4;
+    }
+    while (ptr < end) {
+        hash = rotl(hash + *ptr * PRIME5, 11) * PRIME1;
+        ++ptr;
+    }
+
+    // Avalanche.
+    hash ^= hash >> 15;
+    hash *= PRIME2;
+    hash ^= hash >> 13;
+    hash *= PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+uint32_t xxhash32(const void* data, size_t length, uint32_t seed) {
+    XXHash32State state;
+    xxhash32_init(&state, seed);
+    xxhash32_update(&state, data, length);
+    return xxhash32_digest(&state);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Incremental XXH32 hash state.
+typedef struct {
+    uint32_t acc[4];
+    // Bytes hashed so far.
+    uint32_t total_length;
+    // Input not yet consumed - less than a stripe.
+    uint8_t buffer[16];
+    uint32_t buffer_length;
+    uint32_t seed;
+} XXHash32State;
+
+/// @brief          Start new hash.
+/// @param state    Hash state.
+/// @param seed     Hash seed.
+void xxhash32_init(XXHash32State* state, uint32_t seed);
+
+/// @brief          Hash more data.
+/// @param state    Hash state.
+/// @param data     Data to hash.
+/// @param length   Data length in bytes.
+void xxhash32_update(XXHash32State* state, const void* data, size_t length);
+
+/// @param state    Hash state. Can be updated further.
+/// @return         Hash of all data so far.
+uint32_t xxhash32_digest(const XXHash32State* state);
+
+/// @brief          Hash data at once.
+/// @param data     Data to hash.
+/// @param length   Data length in bytes.
+/// @param seed     Hash seed.
+/// @return         Hash of data.
+uint32_t xxhash32(const void* data, size_t length, uint32_t seed);
@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+"""Load generator for the web server, run on the development machine against the device.
+
+HTTP mode - each client keeps its own connection and requests paths one after another, as
+viewers polling the page do. Reports latency percentiles per path, status codes and
+connections closed by the server, e.g., least recently used sockets purged over the limit.
+
+    load_test.py [-H host] http [-c clients] [-n requests] [-t think_ms] [path...]
+
+WebSocket mode - clients connect to '/ws', then each event is triggered by removing the image,
+which pushes state to all clients. Reports latency from the request to each client receiving
+the state, and CPU usage of each core over the test if the device reports idle time
+('sdkconfig.loadtest'). Run it without GB connected, its state changes are pushed as well.
+
+    load_test.py [-H host] ws [-c clients] [-e events] [-i interval_ms]
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import base64
+import http.client
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+from collections import Counter, defaultdict
+
+DEFAULT_HOST = "gb-printer.local"
+DEFAULT_PATHS = ["/", "/printer-status", "/image"]
+TIMEOUT_S = 10
+PERCENTILES = [50, 90, 99]
+WS_OPCODE_TEXT = 0x1
+WS_OPCODE_CLOSE = 0x8
+WS_OPCODE_PING = 0x9
+WS_OPCODE_PONG = 0xA
+IDLE_COUNTER_WRAP = 1 << 32
+
+
+def percentile(sorted_values, p):
+    """Nearest-rank percentile of sorted values."""
+    if not sorted_values:
+        return float("nan")
+    rank = max(1, -(-len(sorted_values) * p // 100))
+    return sorted_values[rank - 1]
+
+
+def format_latencies(name, latencies_s):
+    """One line with count, percentiles and max in milliseconds."""
+    values = sorted(latency * 1000 for latency in latencies_s)
+    columns = " ".join(f"p{p} {percentile(values, p):7.1f}" for p in PERCENTILES)
+    maximum = values[-1] if values else float("nan")
+    return f"{name:<16} {len(values):6} {columns} max {maximum:7.1f} ms"
+
+
+class HttpResults:
+    """Results shared by client threads."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies_s = defaultdict(list)
+        self.statuses = Counter()
+        self.errors = Counter()
+
+
+def http_client(host, paths, requests, think_s, start, results):
+    """Request paths round robin over a single connection, reconnecting once it's closed."""
+    connection = http.client.HTTPConnection(host, timeout=TIMEOUT_S)
+    start.wait()
+    for i in range(requests):
+        path = paths[i % len(paths)]
+        begin = time.perf_counter()
+        try:
+            connection.request("GET", path)
+            response = connection.getresponse()
+            response.read()
+            latency_s = time.perf_counter() - begin
+            with results.lock:
+                results.latencies_s[path].append(latency_s)
+                results.statuses[response.status] += 1
+        except (OSError, http.client.HTTPException) as error:
+            with results.lock:
+                results.errors[type(error).__name__] += 1
+            connection.close()
+        if think_s > 0:
+            time.sleep(think_s)
+    connection.close()
+
+
+def run_http(args):
+    paths = args.paths or DEFAULT_PATHS
+    results = HttpResults()
+    start = threading.Event()
+    clients = [
+        threading.Thread(target=http_client,
+                         args=(args.host, paths, args.requests, args.think_ms / 1000, start,
+                               results))
+        for _ in range(args.clients)
+    ]
+    for client in clients:
+        client.start()
+    begin = time.perf_counter()
+    start.set()
+    for client in clients:
+        client.join()
+    elapsed_s = time.perf_counter() - begin
+
+    completed = sum(len(latencies) for latencies in results.latencies_s.values())
+    print(f"{args.clients} clients, {completed} requests in {elapsed_s:.1f} s, "
+          f"{completed / elapsed_s:.1f} requests/s")
+    for path in paths:
+        print(format_latencies(path, results.latencies_s[path]))
+    print(format_latencies("all", [latency for latencies in results.latencies_s.values()
+                                   for latency in latencies]))
+    print("statuses: " + (", ".join(f"{status} x{count}"
+                                    for status, count in sorted(results.statuses.items()))
+                          or "none"))
+    print("errors: " + (", ".join(f"{name} x{count}"
+                                  for name, count in sorted(results.errors.items())) or "none"))
+    return 0 if completed > 0 else 1
+
+
+class WsClient:
+    """WebSocket client recording receive time of each state message in its own thread."""
+
+    def __init__(self, host):
+        address, _, port = host.partition(":")
+        self.socket = socket.create_connection((address, int(port or 80)), timeout=TIMEOUT_S)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.socket.sendall((f"GET /ws HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\n"
+                             f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\n"
+                             "Sec-WebSocket-Version: 13\r\n\r\n").encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.socket.recv(1)
+            if not chunk:
+                raise ConnectionError("connection closed during handshake")
+            response += chunk
+        if not response.startswith(b"HTTP/1.1 101"):
+            raise ConnectionError(response.split(b"\r\n")[0].decode(errors="replace"))
+        self.socket.settimeout(None)
+        self.lock = threading.Lock()
+        self.receive_times_s = []
+        self.thread = threading.Thread(target=self.receive, daemon=True)
+        self.thread.start()
+
+    def read(self, length):
+        data = b""
+        while len(data) < length:
+            chunk = self.socket.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("connection closed")
+            data += chunk
+        return data
+
+    def send(self, opcode, payload):
+        # Client frames are masked, an all-zero mask leaves payload as is.
+        assert len(payload) < 126
+        self.socket.sendall(bytes([0x80 | opcode, 0x80 | len(payload), 0, 0, 0, 0]) + payload)
+
+    def receive(self):
+        try:
+            while True:
+                first, second = self.read(2)
+                length = second & 0x7F
+                if length == 126:
+                    length, = struct.unpack(">H", self.read(2))
+                elif length == 127:
+                    length, = struct.unpack(">Q", self.read(8))
+                mask = self.read(4) if second & 0x80 else bytes(4)
+                payload = bytes(b ^ mask[i % 4] for i, b in enumerate(self.read(length)))
+                opcode = first & 0x0F
+                if opcode == WS_OPCODE_TEXT:
+                    with self.lock:
+                        self.receive_times_s.append(time.perf_counter())
+                elif opcode == WS_OPCODE_PING:
+                    self.send(WS_OPCODE_PONG, payload)
+                elif opcode == WS_OPCODE_CLOSE:
+                    break
+        except OSError:
+            pass
+
+    def first_after(self, time_s):
+        """Receive time of the first message after given time, None if there's none yet."""
+        with self.lock:
+            return next((t for t in self.receive_times_s if t > time_s), None)
+
+    def close(self):
+        try:
+            self.send(WS_OPCODE_CLOSE, b"")
+        except OSError:
+            pass
+        self.socket.close()
+
+
+def request(host, method, path):
+    connection = http.client.HTTPConnection(host, timeout=TIMEOUT_S)
+    try:
+        connection.request(method, path)
+        response = connection.getresponse()
+        return response.status, response.read().decode(errors="replace")
+    finally:
+        connection.close()
+
+
+def cpu_counters(host):
+    """Idle time of each core and uptime in microseconds, None if the device lacks them."""
+    _, text = request(host, "GET", "/metrics")
+    idle_us = {int(core): int(value) for core, value in re.findall(
+        r'^gbprinter_idle_time_microseconds_total\{core="(\d+)"\} (\d+)$', text, re.M)}
+    uptime = re.search(r"^gbprinter_uptime_microseconds (\d+)$", text, re.M)
+    if not idle_us or uptime is None:
+        return None
+    return idle_us, int(uptime.group(1))
+
+
+def run_ws(args):
+    clients = []
+    try:
+        for _ in range(args.clients):
+            clients.append(WsClient(args.host))
+    except OSError as error:
+        print(f"{len(clients)} clients connected, then: {error}")
+        return 1
+
+    # State sent once connected isn't an event.
+    deadline_s = time.perf_counter() + TIMEOUT_S
+    while any(client.first_after(0) is None for client in clients):
+        if time.perf_counter() > deadline_s:
+            print("Initial state not received by all clients")
+            return 1
+        time.sleep(0.001)
+
+    cpu_before = cpu_counters(args.host)
+    latencies_s = []
+    missed = 0
+    for _ in range(args.events):
+        sent_s = time.perf_counter()
+        request(args.host, "DELETE", "/delete-image")
+        # Latency is taken from receive times, polling only waits for the messages.
+        pending = list(clients)
+        deadline_s = sent_s + TIMEOUT_S
+        while pending and time.perf_counter() < deadline_s:
+            received = [(client, client.first_after(sent_s)) for client in pending]
+            latencies_s += [time_s - sent_s for _, time_s in received if time_s is not None]
+            pending = [client for client, time_s in received if time_s is None]
+            time.sleep(0.001)
+        missed += len(pending)
+        time.sleep(args.interval_ms / 1000)
+    cpu_after = cpu_counters(args.host)
+
+    for client in clients:
+        client.close()
+    print(f"{args.clients} clients, {args.events} events, {missed} missed")
+    print(format_latencies("event latency", latencies_s))
+    if cpu_before is None or cpu_after is None:
+        print("CPU usage not reported, build with sdkconfig.loadtest")
+    else:
+        uptime_us = cpu_after[1] - cpu_before[1]
+        for core, idle_us in sorted(cpu_after[0].items()):
+            idle_delta_us = (idle_us - cpu_before[0][core]) % IDLE_COUNTER_WRAP
+            print(f"core {core} CPU usage {100 * (1 - idle_delta_us / uptime_us):5.1f} %")
+    return 0 if missed == 0 else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Web server load generator.")
+    parser.add_argument("-H", "--host", default=DEFAULT_HOST,
+                        help=f"device address, default {DEFAULT_HOST}")
+    modes = parser.add_subparsers(dest="mode", required=True)
+
+    http_mode = modes.add_parser("http", help="concurrent HTTP clients")
+    http_mode.add_argument("-c", "--clients", type=int, default=8, help="number of clients")
+    http_mode.add_argument("-n", "--requests", type=int, default=50,
+                           help="requests per client")
+    http_mode.add_argument("-t", "--think-ms", type=float, default=0,
+                           help="delay between requests of a client")
+    http_mode.add_argument("paths", nargs="*", help=f"paths, default {' '.join(DEFAULT_PATHS)}")
+    http_mode.set_defaults(run=run_http)
+
+    ws_mode = modes.add_parser("ws", help="WebSocket clients receiving pushed state")
+    ws_mode.add_argument("-c", "--clients", type=int, default=8, help="number of clients")
+    ws_mode.add_argument("-e", "--events", type=int, default=50, help="number of events")
+    ws_mode.add_argument("-i", "--interval-ms", type=float, default=100,
+                         help="delay between events")
+    ws_mode.set_defaults(run=run_ws)
+
+    args = parser.parse_args()
+    return args.run(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())